@@ -0,0 +1,504 @@
+/* throughput benchmarks for simple-opt's parser and message printers, over
+ * synthetic option arrays and argvs. every case runs in its own child process,
+ * so that its peak memory can be reported alongside its timings, and prints
+ * one JSON object per line:
+ *
+ *   {"bench":"parse","api":"index","options":1000,"args":100000,...}
+ *
+ * see bench --help for the cases which can be selected */
+
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../simple-opt.h"
+
+/* linear lookups cost about options * args string compares, which gets out of
+ * hand at the top of the matrix. cases over this many are skipped */
+#define BENCH_LINEAR_BUDGET 100000000.0
+
+static const unsigned option_counts[] = { 10, 100, 1000, 10000 };
+static const unsigned arg_counts[] = { 10, 1000, 100000, 1000000 };
+
+static const char *mixes[] = { "long", "short" };
+static const char *styles[] = { "eq", "sep", "lookahead" };
+static const char *apis[] = { "linear", "index" };
+
+struct bench_config {
+	double min_time;
+	unsigned max_options;
+	unsigned max_args;
+	const char *filter;
+};
+
+struct bench_case {
+	const char *bench;
+	const char *api;
+	unsigned options;
+	unsigned args;
+	const char *mix;
+	const char *style;
+};
+
+struct bench_schema {
+	struct simple_opt *options;
+	char *names;
+};
+
+struct bench_argv {
+	int argc;
+	char **argv;
+	char *strings;
+};
+
+static uint64_t bench_rand_state = UINT64_C(0x9E3779B97F4A7C15);
+
+static uint32_t bench_rand(void)
+{
+	bench_rand_state ^= bench_rand_state << 13;
+	bench_rand_state ^= bench_rand_state >> 7;
+	bench_rand_state ^= bench_rand_state << 17;
+
+	return (uint32_t)(bench_rand_state >> 32);
+}
+
+static double bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long bench_peak_rss_kb(void)
+{
+	struct rusage ru;
+
+	if (getrusage(RUSAGE_SELF, &ru) != 0)
+		return -1;
+
+#ifdef __APPLE__
+	return ru.ru_maxrss / 1024;
+#else
+	return ru.ru_maxrss;
+#endif
+}
+
+static void *bench_malloc(size_t size)
+{
+	void *p = malloc(size);
+
+	if (p == NULL) {
+		fprintf(stderr, "bench: out of memory\n");
+		exit(1);
+	}
+
+	return p;
+}
+
+/* an option array of count options of mixed types. in the long mix every
+ * option has a long name and a quarter have short names too. in the short mix
+ * every option that can have a short name gets one, and the rest get long
+ * names. with lookahead, every option's argument is optional */
+static void bench_schema_init(struct bench_schema *s, unsigned count,
+		bool short_mix, bool lookahead)
+{
+	static const char shorts[] = "abcdefghijklmnopqrstuvwxyz"
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+	static const enum simple_opt_type types[] = {
+		SIMPLE_OPT_FLAG, SIMPLE_OPT_INT, SIMPLE_OPT_STRING,
+		SIMPLE_OPT_DOUBLE, SIMPLE_OPT_BOOL,
+	};
+	unsigned i, n_short = 0;
+	char short_name, *long_name;
+
+	s->options = bench_malloc((count + 1) * sizeof(*s->options));
+	s->names = bench_malloc(count * 32);
+	memset(s->options, 0, (count + 1) * sizeof(*s->options));
+
+	for (i = 0; i < count; i++) {
+		short_name = '\0';
+		long_name = NULL;
+
+		if (n_short < sizeof(shorts) - 1 && (short_mix || i % 4 == 0))
+			short_name = shorts[n_short++];
+
+		if (!short_mix || short_name == '\0') {
+			long_name = s->names + 32 * i;
+			snprintf(long_name, 32, "synthetic-option-%u", i);
+		}
+
+		/* short_name is const, so the option can't be assigned to */
+		{
+			struct simple_opt o = { types[i % 5], short_name, long_name,
+				!lookahead && types[i % 5] != SIMPLE_OPT_FLAG,
+				"a synthetic option for benchmarking" };
+
+			memcpy(s->options + i, &o, sizeof(o));
+		}
+	}
+
+	s->options[count].type = SIMPLE_OPT_END;
+}
+
+static void bench_schema_free(struct bench_schema *s)
+{
+	free(s->options);
+	free(s->names);
+}
+
+/* an argv of count arguments (or one more, to finish the last option), all of
+ * them options or their arguments, so that the legacy result's non-option
+ * limit isn't reached.
+ * options are passed by short name if they have one and the mix is short, or
+ * by long name otherwise. in the eq style long options take their argument
+ * after '=', and otherwise it's the next argument. with lookahead, half of
+ * the options which could take an argument are passed without one */
+static void bench_argv_init(struct bench_argv *a, unsigned count,
+		const struct bench_schema *s, unsigned n_options, bool short_mix,
+		bool eq, bool lookahead)
+{
+	static const char *values[] = {
+		NULL, "12345", "some-string-value", "3.25", "yes",
+	};
+	const struct simple_opt *o;
+	size_t off = 0, cap;
+	int n;
+
+	cap = (size_t)count * 64 + 64;
+	a->strings = bench_malloc(cap);
+	a->argv = bench_malloc((count + 3) * sizeof(*a->argv));
+	a->argv[0] = "bench";
+	a->argc = 1;
+
+	while ((unsigned)a->argc <= count) {
+		/* the short mix mostly passes options which have short names */
+		if (short_mix && bench_rand() % 10 != 0)
+			o = s->options + bench_rand() % (n_options < 62 ? n_options : 62);
+		else
+			o = s->options + bench_rand() % n_options;
+
+		a->argv[a->argc++] = a->strings + off;
+
+		if (o->short_name != '\0' && (short_mix || o->long_name == NULL))
+			n = sprintf(a->strings + off, "-%c", o->short_name);
+		else if (eq && o->type != SIMPLE_OPT_FLAG && !lookahead)
+			n = sprintf(a->strings + off, "--%s=%s", o->long_name,
+					values[o->type == SIMPLE_OPT_INT ? 1
+						: o->type == SIMPLE_OPT_STRING ? 2
+						: o->type == SIMPLE_OPT_DOUBLE ? 3 : 4]);
+		else
+			n = sprintf(a->strings + off, "--%s", o->long_name);
+		off += n + 1;
+
+		if (o->type == SIMPLE_OPT_FLAG
+				|| strchr(a->argv[a->argc - 1], '=') != NULL
+				|| (lookahead && bench_rand() % 2 == 0))
+			continue;
+
+		a->argv[a->argc++] = (char *)values[o->type == SIMPLE_OPT_INT ? 1
+			: o->type == SIMPLE_OPT_STRING ? 2
+			: o->type == SIMPLE_OPT_DOUBLE ? 3 : 4];
+	}
+
+	a->argv[a->argc] = NULL;
+}
+
+static void bench_argv_free(struct bench_argv *a)
+{
+	free(a->argv);
+	free(a->strings);
+}
+
+static void bench_report(const struct bench_case *c, const char *unit,
+		double ns, unsigned long iterations)
+{
+	printf("{\"bench\":\"%s\",\"api\":\"%s\",\"options\":%u,\"args\":%u,"
+			"\"mix\":\"%s\",\"style\":\"%s\",\"%s\":%.2f,"
+			"\"iterations\":%lu,\"peak_rss_kb\":%ld}\n",
+			c->bench, c->api, c->options, c->args, c->mix, c->style, unit, ns,
+			iterations, bench_peak_rss_kb());
+}
+
+/* time parsing. each batch runs until a tenth of the minimum time has passed,
+ * and the best batch is reported */
+static void bench_parse(const struct bench_config *cfg,
+		const struct bench_case *c)
+{
+	struct bench_schema s;
+	struct bench_argv a;
+	struct simple_opt_index idx;
+	struct simple_opt_result r;
+	bool short_mix, lookahead, use_index;
+	double start, batch_start, now, best = -1;
+	unsigned long i, iterations = 0;
+
+	short_mix = !strcmp(c->mix, "short");
+	lookahead = !strcmp(c->style, "lookahead");
+	use_index = !strcmp(c->api, "index");
+
+	bench_schema_init(&s, c->options, short_mix, lookahead);
+	bench_argv_init(&a, c->args, &s, c->options, short_mix,
+			!strcmp(c->style, "eq"), lookahead);
+
+	if (use_index && simple_opt_compile(&idx, s.options)
+			!= SIMPLE_OPT_RESULT_SUCCESS) {
+		fprintf(stderr, "bench: couldn't compile options\n");
+		exit(1);
+	}
+
+	start = bench_now();
+	do {
+		batch_start = bench_now();
+		for (i = 0; ; i++) {
+			if (use_index)
+				r = simple_opt_parse_index(a.argc, a.argv, &idx);
+			else
+				r = simple_opt_parse(a.argc, a.argv, s.options);
+
+			if (r.result_type != SIMPLE_OPT_RESULT_SUCCESS) {
+				fprintf(stderr, "bench: synthetic argv failed to parse\n");
+				simple_opt_print_error(stderr, 80, "bench", r);
+				exit(1);
+			}
+
+			now = bench_now();
+			if (now - batch_start >= cfg->min_time / 10)
+				break;
+		}
+
+		iterations += i + 1;
+		if (best < 0 || (now - batch_start) / (i + 1) < best)
+			best = (now - batch_start) / (i + 1);
+	} while (now - start < cfg->min_time);
+
+	bench_report(c, "ns_per_arg", best * 1e9 / (a.argc - 1), iterations);
+
+	if (use_index)
+		simple_opt_index_free(&idx);
+	bench_argv_free(&a);
+	bench_schema_free(&s);
+}
+
+static unsigned bench_count_lines(const char *s, size_t len)
+{
+	unsigned lines = 0;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		lines += s[i] == '\n';
+
+	return lines;
+}
+
+/* time printing a usage message or error message to /dev/null, per line
+ * printed */
+static void bench_print(const struct bench_config *cfg,
+		const struct bench_case *c, FILE *null)
+{
+	static const char *usage_options = "[OPTION]... [--] [NON-OPTION]...";
+	static const char *usage_summary = "synthetic options for benchmarking "
+		"usage printing, long enough to wrap once or twice at a width of 80 "
+		"columns.";
+	struct bench_schema s;
+	struct simple_opt_result r;
+	struct simple_opt_result_into ri;
+	char *argv[] = { "bench", NULL, "not-a-number", NULL };
+	char *buf;
+	size_t len;
+	bool usage;
+	double start, now;
+	unsigned long i;
+	unsigned lines;
+
+	usage = !strcmp(c->bench, "usage");
+
+	bench_schema_init(&s, c->options, false, false);
+
+	/* render the message once to count its lines */
+	if (usage) {
+		len = simple_opt_render_usage(NULL, 0, 80, "bench",
+				(char *)usage_options, (char *)usage_summary, s.options);
+		buf = bench_malloc(len + 1);
+		simple_opt_render_usage(buf, len + 1, 80, "bench",
+				(char *)usage_options, (char *)usage_summary, s.options);
+	} else {
+		/* an unrecognised option, or a bad argument to an INT option */
+		argv[1] = !strcmp(c->style, "unrecognised") ? "--no-such-option"
+			: "--synthetic-option-1";
+		r = simple_opt_parse(3, argv, s.options);
+
+		simple_opt_parse_into(3, argv, s.options, &ri);
+		len = simple_opt_render_error(NULL, 0, 80, "bench", &ri);
+		buf = bench_malloc(len + 1);
+		simple_opt_render_error(buf, len + 1, 80, "bench", &ri);
+	}
+
+	lines = bench_count_lines(buf, len);
+	free(buf);
+
+	start = bench_now();
+	for (i = 0; ; i++) {
+		if (usage)
+			simple_opt_print_usage(null, 80, "bench", (char *)usage_options,
+					(char *)usage_summary, s.options);
+		else
+			simple_opt_print_error(null, 80, "bench", r);
+
+		now = bench_now();
+		if (now - start >= cfg->min_time)
+			break;
+	}
+
+	bench_report(c, "ns_per_line", (now - start) * 1e9 / (i + 1) / lines,
+			i + 1);
+
+	bench_schema_free(&s);
+}
+
+static bool bench_selected(const struct bench_config *cfg,
+		const struct bench_case *c)
+{
+	char name[128];
+
+	if (c->options > cfg->max_options || c->args > cfg->max_args)
+		return false;
+
+	if (!strcmp(c->api, "linear")
+			&& (double)c->options * c->args > BENCH_LINEAR_BUDGET)
+		return false;
+
+	if (cfg->filter == NULL)
+		return true;
+
+	snprintf(name, sizeof(name), "%s/%s/%u/%u/%s/%s", c->bench, c->api,
+			c->options, c->args, c->mix, c->style);
+
+	return strstr(name, cfg->filter) != NULL;
+}
+
+/* run a case in a child process, so that its peak memory is its own */
+static void bench_run(const struct bench_config *cfg,
+		const struct bench_case *c, FILE *null)
+{
+	pid_t pid;
+	int status;
+
+	if (!bench_selected(cfg, c))
+		return;
+
+	fflush(stdout);
+
+	pid = fork();
+	if (pid < 0) {
+		perror("bench: fork");
+		exit(1);
+	}
+
+	if (pid == 0) {
+		if (!strcmp(c->bench, "parse"))
+			bench_parse(cfg, c);
+		else
+			bench_print(cfg, c, null);
+
+		fflush(stdout);
+		_exit(0);
+	}
+
+	if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status)
+			|| WEXITSTATUS(status) != 0) {
+		fprintf(stderr, "bench: case %s/%s/%u/%u/%s/%s failed\n", c->bench,
+				c->api, c->options, c->args, c->mix, c->style);
+		exit(1);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	struct simple_opt options[] = {
+		{ SIMPLE_OPT_FLAG, 'h', "help", false,
+			"print this help message and exit" },
+		{ SIMPLE_OPT_DOUBLE, 't', "min-time", true,
+			"the minimum time to spend timing each case, in seconds "
+				"(default 0.2)", "SECONDS" },
+		{ SIMPLE_OPT_FLAG, 'q', "quick", false,
+			"limit cases to 1000 options and 100000 args" },
+		{ SIMPLE_OPT_STRING, 'f', "filter", true,
+			"only run cases whose name, "
+				"bench/api/options/args/mix/style, contains FILTER",
+			"FILTER" },
+		{ SIMPLE_OPT_END },
+	};
+	struct simple_opt_result result;
+	struct bench_config cfg;
+	struct bench_case c;
+	size_t i, j, k, l, m;
+	FILE *null;
+
+	result = simple_opt_parse(argc, argv, options);
+
+	if (result.result_type != SIMPLE_OPT_RESULT_SUCCESS) {
+		simple_opt_print_error(stderr, 80, argv[0], result);
+		return 1;
+	}
+
+	if (options[0].was_seen || result.argc > 0) {
+		simple_opt_print_usage(stdout, 80, argv[0], "[OPTION]...",
+				"Benchmark simple-opt, printing a JSON object per case. "
+				"parse cases report ns_per_arg, for every combination of "
+				"api (linear or index), options (10 to 10000), args (10 to "
+				"1000000), mix (long or short names) and style (eq, sep or "
+				"lookahead). usage and error cases report ns_per_line.",
+				options);
+		return options[0].was_seen ? 0 : 1;
+	}
+
+	cfg.min_time = options[1].was_seen ? options[1].val.v_double : 0.2;
+	cfg.max_options = options[2].was_seen ? 1000 : 10000;
+	cfg.max_args = options[2].was_seen ? 100000 : 1000000;
+	cfg.filter = options[3].was_seen ? options[3].val.v_string : NULL;
+
+	null = fopen("/dev/null", "w");
+	if (null == NULL) {
+		perror("bench: /dev/null");
+		return 1;
+	}
+
+	c.bench = "parse";
+	for (i = 0; i < sizeof(apis) / sizeof(*apis); i++)
+	for (j = 0; j < sizeof(option_counts) / sizeof(*option_counts); j++)
+	for (k = 0; k < sizeof(arg_counts) / sizeof(*arg_counts); k++)
+	for (l = 0; l < sizeof(mixes) / sizeof(*mixes); l++)
+	for (m = 0; m < sizeof(styles) / sizeof(*styles); m++) {
+		c.api = apis[i];
+		c.options = option_counts[j];
+		c.args = arg_counts[k];
+		c.mix = mixes[l];
+		c.style = styles[m];
+		bench_run(&cfg, &c, null);
+	}
+
+	c.api = "print";
+	c.args = 0;
+	c.mix = "long";
+	for (j = 0; j < sizeof(option_counts) / sizeof(*option_counts); j++) {
+		c.options = option_counts[j];
+
+		c.bench = "usage";
+		c.style = "width80";
+		bench_run(&cfg, &c, null);
+
+		c.bench = "error";
+		c.style = "unrecognised";
+		bench_run(&cfg, &c, null);
+		c.style = "bad_arg";
+		bench_run(&cfg, &c, null);
+	}
+
+	fclose(null);
+
+	return 0;
+}
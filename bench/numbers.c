@@ -0,0 +1,363 @@
+/* checks simple-opt's built-in number parsers against strtol, strtoul and
+ * strtod. each parser is given hand-picked edge cases, then random inputs
+ * shaped to reach its fast paths (8 digits at a time for integers, the exact
+ * multiply or divide for doubles) and the boundaries between them and the
+ * slow ones. a parser and libc must agree on whether an input is accepted,
+ * and on its value to the bit. mismatches are printed, one per line:
+ *
+ *   double "1.5e-7": simple-opt ok 0x3e84213d05248dd0, libc ok 0x...
+ *
+ * with --locale, simple-opt parses in that locale while libc still parses in
+ * the "C" one, to check that the locale makes no difference. a parser must
+ * also leave errno as it was
+ *
+ * see numbers --help for the options */
+
+#include <locale.h>
+#include <math.h>
+
+#include "../simple-opt.h"
+
+#ifdef SIMPLE_OPT_LIBC_NUMBERS
+#error "check compares the built-in parsers with libc, so needs them built in"
+#endif
+
+/* the most mismatches printed before the rest are only counted */
+#define CHECK_MAX_PRINTED 20
+
+static const char *edge_cases[] = {
+	"", " ", "+", "-", "0", "-0", "+0", "00", "0x", "0X", "0x0", "0xg", "08",
+	"07", "0.", ".", ".0", "0.0", "-.5", "1e", "1e+", "1e-", "1e5", "1E5",
+	"1.e5", ".1e5", " 1", "\t1", "\n-1", "1 ", "1x", "x1", "+-1", "-+1",
+	"--1", "0x-1", "12345678", "123456789", "1234567812345678",
+	"12345678123456781", "00000000000000000000001",
+	"9223372036854775807", "9223372036854775808", "-9223372036854775808",
+	"-9223372036854775809", "18446744073709551615", "18446744073709551616",
+	"-18446744073709551615", "-18446744073709551616",
+	"0x7fffffffffffffff", "0x8000000000000000", "-0x8000000000000000",
+	"0xffffffffffffffff", "0x10000000000000000", "0777777777777777777777",
+	"01777777777777777777777", "02000000000000000000000",
+	"2147483647", "2147483648", "-2147483648", "-2147483649", "4294967295",
+	"4294967296", "9007199254740992", "9007199254740993", "1e22", "1e23",
+	"1e-22", "1e-23", "9007199254740993e22", "123456789012345678901234567890",
+	"0.000000000000000000000000000001", "1.7976931348623157e308", "1e309",
+	"4.9e-324", "2e-324", "1e-400", "inf", "-inf", "infinity", "nan", "NaN",
+	"0x1p3", "0x1.8p1", "1,5", "1_000", "1.00000000000000000000001",
+	"0x1,8p1", "1.5e400",
+};
+
+/* the magnitudes of LONG_MAX, LONG_MIN and ULONG_MAX where long is 64 bits,
+ * around which overflow is checked */
+static const char *limits[] = {
+	"9223372036854775807", "9223372036854775808", "18446744073709551615",
+};
+
+/* characters which make inputs that fail in interesting places */
+static const char junk[] = "0123456789+-.eExX \t";
+
+static uint64_t check_rand_state = UINT64_C(0x9E3779B97F4A7C15);
+
+static uint32_t check_rand(void)
+{
+	check_rand_state ^= check_rand_state << 13;
+	check_rand_state ^= check_rand_state >> 7;
+	check_rand_state ^= check_rand_state << 17;
+
+	return (uint32_t)(check_rand_state >> 32);
+}
+
+static unsigned long mismatches;
+
+/* the locales simple-opt and libc parse in, if set by --locale */
+static locale_t check_locale, check_c_locale;
+
+/* run simple-opt's parser p over s in check_locale, checking errno is left
+ * alone, then switch to the "C" locale for libc */
+#define CHECK_PARSE(type, p, s, v, ok) do { \
+	if (check_locale != (locale_t)0) \
+		uselocale(check_locale); \
+	errno = EDOM; \
+	(ok) = p((s), (v)); \
+	if (errno != EDOM && mismatches++ < CHECK_MAX_PRINTED) \
+		printf("%s \"%s\": simple-opt changed errno\n", (type), (s)); \
+	if (check_c_locale != (locale_t)0) \
+		uselocale(check_c_locale); \
+} while (0)
+
+static void check_mismatch(const char *type, const char *s, bool ok,
+		uint64_t v, bool libc_ok, uint64_t libc_v)
+{
+	if (mismatches++ >= CHECK_MAX_PRINTED)
+		return;
+
+	printf("%s \"%s\": simple-opt %s 0x%016llx, libc %s 0x%016llx\n", type, s,
+			ok ? "ok" : "rejects", (unsigned long long)v,
+			libc_ok ? "ok" : "rejects", (unsigned long long)libc_v);
+}
+
+static void check_long(const char *s)
+{
+	long v = 0, libc_v;
+	bool ok, libc_ok;
+	char *cp;
+
+	CHECK_PARSE("int", sub_simple_opt_parse_long, s, &v, ok);
+
+	errno = 0;
+	libc_v = strtol(s, &cp, 0);
+	libc_ok = cp != s && *cp == '\0' && !errno;
+
+	if (ok != libc_ok || (ok && v != libc_v))
+		check_mismatch("int", s, ok, (uint64_t)v, libc_ok, (uint64_t)libc_v);
+}
+
+static void check_ulong(const char *s)
+{
+	unsigned long v = 0, libc_v;
+	bool ok, libc_ok;
+	char *cp;
+
+	CHECK_PARSE("unsigned", sub_simple_opt_parse_ulong, s, &v, ok);
+
+	errno = 0;
+	libc_v = strtoul(s, &cp, 0);
+	libc_ok = cp != s && *cp == '\0' && !errno;
+
+	if (ok != libc_ok || (ok && v != libc_v))
+		check_mismatch("unsigned", s, ok, v, libc_ok, libc_v);
+}
+
+static void check_double(const char *s)
+{
+	double v = 0, libc_v;
+	uint64_t bits = 0, libc_bits;
+	bool ok, libc_ok;
+	char *cp;
+
+	CHECK_PARSE("double", sub_simple_opt_parse_double, s, &v, ok);
+
+	errno = 0;
+	libc_v = strtod(s, &cp);
+	libc_ok = cp != s && *cp == '\0' && !errno;
+
+	memcpy(&bits, &v, sizeof(bits));
+	memcpy(&libc_bits, &libc_v, sizeof(libc_bits));
+
+	/* nans needn't match to the bit */
+	if (ok != libc_ok || (ok && bits != libc_bits
+				&& !(isnan(v) && isnan(libc_v))))
+		check_mismatch("double", s, ok, bits, libc_ok, libc_bits);
+}
+
+static void check_all(const char *s)
+{
+	check_long(s);
+	check_ulong(s);
+	check_double(s);
+}
+
+/* n random decimal digits, the first of them not 0 unless n is 1 */
+static size_t check_digits(char *s, unsigned n)
+{
+	unsigned i;
+
+	for (i = 0; i < n; i++)
+		s[i] = '0' + check_rand() % 10;
+
+	if (n > 1 && s[0] == '0')
+		s[0] = '1' + check_rand() % 9;
+
+	return n;
+}
+
+/* an integer, mostly decimal with up to 24 digits, around the sizes at which
+ * a long or unsigned long overflows */
+static void check_random_integer(char *s)
+{
+	size_t n = 0;
+	unsigned i, len;
+
+	if (check_rand() % 8 == 0)
+		s[n++] = " \t"[check_rand() % 2];
+
+	if (check_rand() % 3 == 0)
+		s[n++] = "+-"[check_rand() % 2];
+
+	switch (check_rand() % 8) {
+	case 7:
+		/* a limit with some of its last digits changed, so that it's just
+		 * under or just over */
+		strcpy(s + n, limits[check_rand() % 3]);
+		len = (unsigned)strlen(s + n);
+		for (i = len - 1 - check_rand() % 10; i < len; i++)
+			s[n + i] = '0' + check_rand() % 10;
+		n += len;
+		break;
+	case 0:
+		s[n++] = '0';
+		s[n++] = "xX"[check_rand() % 2];
+		for (i = 0, len = 1 + check_rand() % 18; i < len; i++)
+			s[n++] = "0123456789abcdefABCDEF"[check_rand() % 22];
+		break;
+	case 1:
+		s[n++] = '0';
+		for (i = 0, len = check_rand() % 23; i < len; i++)
+			s[n++] = '0' + check_rand() % 8;
+		break;
+	default:
+		n += check_digits(s + n, 1 + check_rand() % 24);
+		break;
+	}
+
+	s[n] = '\0';
+}
+
+/* a decimal double, mostly within the fast path's 19 significant digits and
+ * powers of ten up to 22, but sometimes just past either */
+static void check_random_double(char *s)
+{
+	size_t n = 0;
+	unsigned len, point;
+
+	if (check_rand() % 3 == 0)
+		s[n++] = "+-"[check_rand() % 2];
+
+	len = 1 + check_rand() % 22;
+
+	if (check_rand() % 4 == 0) {
+		/* leading zeros, which aren't significant */
+		s[n++] = '0';
+		s[n++] = '.';
+		while (check_rand() % 2 == 0)
+			s[n++] = '0';
+		n += check_digits(s + n, len);
+	} else {
+		/* a point after any of the digits but the last, or none */
+		point = check_rand() % (len + 1);
+		n += check_digits(s + n, point);
+		if (point < len) {
+			s[n++] = '.';
+			n += check_digits(s + n, len - point);
+		}
+	}
+
+	if (check_rand() % 2 == 0)
+		n += sprintf(s + n, "e%d", (int)(check_rand() % 61) - 30);
+
+	s[n] = '\0';
+}
+
+/* a double printed from random bits, round-tripped at 17 digits, or
+ * printed short so that it rounds */
+static void check_random_bits(char *s)
+{
+	uint64_t bits;
+	double d;
+
+	bits = (uint64_t)check_rand() << 32 | check_rand();
+	memcpy(&d, &bits, sizeof(d));
+
+	if (isnan(d) || isinf(d))
+		d = 1.0 / (1 + check_rand() % 1000);
+
+	sprintf(s, "%.*g", 1 + (int)(check_rand() % 17), d);
+}
+
+/* a short string of characters from junk */
+static void check_random_junk(char *s)
+{
+	unsigned i, len = check_rand() % 8;
+
+	for (i = 0; i < len; i++)
+		s[i] = junk[check_rand() % (sizeof(junk) - 1)];
+
+	s[len] = '\0';
+}
+
+int main(int argc, char **argv)
+{
+	struct simple_opt options[] = {
+		{ SIMPLE_OPT_FLAG, 'h', "help", false,
+			"print this help message and exit" },
+		{ SIMPLE_OPT_UNSIGNED, 'n', "count", true,
+			"the number of random inputs to check (default 2000000)", "N" },
+		{ SIMPLE_OPT_UNSIGNED, 's', "seed", true,
+			"seed the random inputs with N", "N" },
+		{ SIMPLE_OPT_STRING, 'l', "locale", true,
+			"parse with simple-opt in locale NAME's number format, and with "
+			"libc in \"C\"", "NAME" },
+		{ SIMPLE_OPT_END },
+	};
+	struct simple_opt_result result;
+	unsigned long count, i;
+	char s[128];
+
+	result = simple_opt_parse(argc, argv, options);
+
+	if (result.result_type != SIMPLE_OPT_RESULT_SUCCESS) {
+		simple_opt_print_error(stderr, 80, argv[0], result);
+		return 1;
+	}
+
+	if (options[0].was_seen || result.argc > 0) {
+		simple_opt_print_usage(stdout, 80, argv[0], "[OPTION]...",
+				"Check simple-opt's INT, UNSIGNED and DOUBLE parsers against "
+				"strtol, strtoul and strtod, over edge cases and random "
+				"inputs. mismatches are printed, and make the exit status "
+				"1.", options);
+		return options[0].was_seen ? 0 : 1;
+	}
+
+	if (options[3].was_seen) {
+		check_c_locale = newlocale(LC_ALL_MASK, "C", (locale_t)0);
+		check_locale = newlocale(LC_NUMERIC_MASK, options[3].val.v_string,
+				newlocale(LC_ALL_MASK, "C", (locale_t)0));
+		if (check_locale == (locale_t)0 || check_c_locale == (locale_t)0) {
+			fprintf(stderr, "%s: unable to load locale `%s`\n", argv[0],
+					options[3].val.v_string);
+			return 1;
+		}
+	}
+
+	count = options[1].was_seen ? options[1].val.v_unsigned : 2000000;
+	if (options[2].was_seen)
+		check_rand_state ^= options[2].val.v_unsigned
+			* UINT64_C(0x2545F4914F6CDD1D);
+
+	for (i = 0; i < sizeof(edge_cases) / sizeof(*edge_cases); i++)
+		check_all(edge_cases[i]);
+
+	for (i = 0; i < count; i++) {
+		switch (i % 4) {
+		case 0:
+			check_random_integer(s);
+			break;
+		case 1:
+			check_random_double(s);
+			break;
+		case 2:
+			check_random_bits(s);
+			break;
+		default:
+			check_random_junk(s);
+			break;
+		}
+
+		check_all(s);
+	}
+
+	if (mismatches > CHECK_MAX_PRINTED)
+		printf("... and %lu more\n", mismatches - CHECK_MAX_PRINTED);
+
+	printf("checked %lu inputs, %lu mismatches\n",
+			(unsigned long)(sizeof(edge_cases) / sizeof(*edge_cases)) + count,
+			mismatches);
+
+	if (check_locale != (locale_t)0) {
+		uselocale(LC_GLOBAL_LOCALE);
+		freelocale(check_locale);
+		freelocale(check_c_locale);
+	}
+
+	return mismatches > 0;
+}
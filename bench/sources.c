@@ -0,0 +1,167 @@
+/* checks that values from config files, the environment and the cli take
+ * precedence over each other in that order, whichever is parsed first. each
+ * case layers sources over a fresh set of options and compares the state of
+ * one option with what's expected. failures are printed, one per line:
+ *
+ *   config true, env false: was_seen 1 count 1 source 1, expected 0 0 2 */
+
+#include <unistd.h>
+
+#include "../simple-opt.h"
+
+struct check_case {
+	const char *name;
+
+	/* the contents of the config file, or NULL to parse none */
+	const char *config;
+
+	/* NULL-terminated, or NULL to parse no environment */
+	const char *env[4];
+
+	/* NULL-terminated, after the command name, or NULL to parse no argv */
+	const char *argv[4];
+
+	/* whether the environment is parsed before the config file */
+	bool env_first;
+
+	bool was_seen;
+	unsigned long count;
+	enum simple_opt_source source;
+};
+
+static const struct check_case cases[] = {
+	{ "config true", "verbose = true\n", { NULL }, { NULL }, false,
+		true, 1, SIMPLE_OPT_SOURCE_CONFIG },
+	{ "config false", "verbose = false\n", { NULL }, { NULL }, false,
+		false, 0, SIMPLE_OPT_SOURCE_CONFIG },
+	{ "config true, env false", "verbose = true\n", { "APP_VERBOSE=false" },
+		{ NULL }, false, false, 0, SIMPLE_OPT_SOURCE_ENV },
+	{ "env false, config true", "verbose = true\n", { "APP_VERBOSE=false" },
+		{ NULL }, true, false, 0, SIMPLE_OPT_SOURCE_ENV },
+	{ "config true, env false, cli", "verbose = true\n",
+		{ "APP_VERBOSE=false" }, { "-v" }, false,
+		true, 1, SIMPLE_OPT_SOURCE_CLI },
+	{ "env empty", NULL, { "APP_VERBOSE=" }, { NULL }, false,
+		true, 1, SIMPLE_OPT_SOURCE_ENV },
+	{ "env 1", NULL, { "APP_VERBOSE=1" }, { NULL }, false,
+		true, 1, SIMPLE_OPT_SOURCE_ENV },
+	{ "env 0", NULL, { "APP_VERBOSE=0" }, { NULL }, false,
+		false, 0, SIMPLE_OPT_SOURCE_ENV },
+	{ "config true, env 0", "verbose = true\n", { "APP_VERBOSE=0" },
+		{ NULL }, false, false, 0, SIMPLE_OPT_SOURCE_ENV },
+	{ "env off, config yes", "verbose = yes\n", { "APP_VERBOSE=off" },
+		{ NULL }, true, false, 0, SIMPLE_OPT_SOURCE_ENV },
+	{ "config false, env true", "verbose = false\n", { "APP_VERBOSE=true" },
+		{ NULL }, false, true, 1, SIMPLE_OPT_SOURCE_ENV },
+	{ "env 0, cli twice", NULL, { "APP_VERBOSE=0" }, { "-vv" }, false,
+		true, 2, SIMPLE_OPT_SOURCE_CLI },
+};
+
+static struct simple_opt options[] = {
+	{ SIMPLE_OPT_FLAG, 'v', "verbose", false },
+	{ SIMPLE_OPT_END },
+};
+
+/* write config to a temporary file, returning its path, or NULL */
+static char *write_config(const char *config, char *path, size_t size)
+{
+	const char *dir = getenv("TMPDIR");
+	size_t len = strlen(config);
+	int fd;
+
+	snprintf(path, size, "%s/simple-opt-sources-XXXXXX",
+			dir != NULL && dir[0] != '\0' ? dir : "/tmp");
+
+	fd = mkstemp(path);
+	if (fd == -1)
+		return NULL;
+
+	if (write(fd, config, len) != (ssize_t)len) {
+		close(fd);
+		unlink(path);
+		return NULL;
+	}
+
+	close(fd);
+	return path;
+}
+
+/* parse c's sources into options, returning whether every parse succeeded */
+static bool parse_case(const struct check_case *c, char *path)
+{
+	struct simple_opt_result_into r = { 0 };
+	char *argv[5] = { (char *)"sources" };
+	char **envp = (char **)c->env;
+	int argc, i;
+	bool ok = true;
+
+	if (c->env_first && c->env[0] != NULL)
+		ok = ok && simple_opt_parse_env(options, "APP_", envp, &r)
+			== SIMPLE_OPT_RESULT_SUCCESS;
+
+	if (c->config != NULL)
+		ok = ok && simple_opt_parse_config(options, path, &r)
+			== SIMPLE_OPT_RESULT_SUCCESS;
+
+	if (!c->env_first && c->env[0] != NULL)
+		ok = ok && simple_opt_parse_env(options, "APP_", envp, &r)
+			== SIMPLE_OPT_RESULT_SUCCESS;
+
+	if (c->argv[0] != NULL) {
+		for (argc = 1, i = 0; c->argv[i] != NULL; i++)
+			argv[argc++] = (char *)c->argv[i];
+		argv[argc] = NULL;
+
+		ok = ok && simple_opt_parse_into(argc, argv, options, &r)
+			== SIMPLE_OPT_RESULT_SUCCESS;
+	}
+
+	simple_opt_result_into_free(&r);
+	return ok;
+}
+
+int main(void)
+{
+	char buf[4096], *path;
+	size_t i;
+	unsigned long failures = 0;
+	const struct check_case *c;
+	const struct simple_opt *o = options;
+
+	for (i = 0; i < sizeof(cases) / sizeof(*cases); i++) {
+		c = cases + i;
+		path = NULL;
+
+		if (c->config != NULL) {
+			path = write_config(c->config, buf, sizeof(buf));
+			if (path == NULL) {
+				perror("sources: unable to write a config file");
+				return 1;
+			}
+		}
+
+		options[0].was_seen = false;
+		options[0].arg_is_stored = false;
+		options[0].source = SIMPLE_OPT_SOURCE_DEFAULT;
+		options[0].val.v_count = 0;
+
+		if (!parse_case(c, path)) {
+			printf("%s: a source failed to parse\n", c->name);
+			failures++;
+		} else if (o->was_seen != c->was_seen
+				|| (o->was_seen && o->val.v_count != c->count)
+				|| o->source != c->source) {
+			printf("%s: was_seen %d count %lu source %d, expected %d %lu %d\n",
+					c->name, o->was_seen, o->val.v_count, (int)o->source,
+					c->was_seen, c->count, (int)c->source);
+			failures++;
+		}
+
+		if (path != NULL)
+			unlink(path);
+	}
+
+	printf("checked %lu cases, %lu failures\n",
+			(unsigned long)(sizeof(cases) / sizeof(*cases)), failures);
+	return failures > 0;
+}
@@ -8,6 +8,66 @@
 #include <stdint.h>
 #include <ctype.h>
 #include <errno.h>
+#include <limits.h>
+#include <float.h>
+#include <locale.h>
+
+#ifdef SIMPLE_OPT_STATS
+#include <time.h>
+#endif
+
+/* each cli argument is scanned 16 bytes at a time where sse2 is available.
+ * define SIMPLE_OPT_NO_SIMD to scan a byte at a time instead */
+#if defined(__SSE2__) && !defined(SIMPLE_OPT_NO_SIMD)
+#include <emmintrin.h>
+#define SUB_SIMPLE_OPT_SSE2
+
+/* the scan reads whole aligned blocks, which may run past the end of an
+ * argument but never off its page. that's safe, but not to asan */
+#if defined(__SANITIZE_ADDRESS__)
+#define SUB_SIMPLE_OPT_NO_ASAN __attribute__((no_sanitize_address))
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define SUB_SIMPLE_OPT_NO_ASAN __attribute__((no_sanitize_address))
+#endif
+#endif
+#ifndef SUB_SIMPLE_OPT_NO_ASAN
+#define SUB_SIMPLE_OPT_NO_ASAN
+#endif
+#endif
+
+/* the environment, for simple_opt_parse_env */
+#if defined(__unix__) || defined(__APPLE__)
+#ifdef __cplusplus
+extern "C" char **environ;
+#else
+extern char **environ;
+#endif
+#define SUB_SIMPLE_OPT_ENVIRON environ
+#endif
+
+/* simple_opt_parse_batch spreads its parses over a pool of threads if
+ * SIMPLE_OPT_THREADS is defined (and the program is linked with -pthread), and
+ * otherwise makes them one after another */
+#ifdef SIMPLE_OPT_THREADS
+#include <pthread.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* response and config files are mapped into memory where possible, and
+ * otherwise read */
+#if defined(MAP_ANONYMOUS) || defined(MAP_ANON)
+#define SUB_SIMPLE_OPT_MMAP
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
 
 /* the maximum number of options that can be passed on the cli */
 #ifndef SIMPLE_OPT_MAX_ARGC
@@ -19,17 +79,76 @@
 #define SIMPLE_OPT_OPT_MAX_WIDTH 512
 #endif
 
-/* the maximum allowed width for an option's argument passed on the cli */
+/* the maximum allowed width for an option's argument passed on the cli. it
+ * limits string arguments copied into a struct simple_opt, which they aren't
+ * if SIMPLE_OPT_STRING_REF is defined, and the copy in struct
+ * simple_opt_result */
 #ifndef SIMPLE_OPT_OPT_ARG_MAX_WIDTH
 #define SIMPLE_OPT_OPT_ARG_MAX_WIDTH 2048
 #endif
 
+/* the maximum depth to which response files (see SIMPLE_OPT_RESPONSE_FILES)
+ * may be nested */
+#ifndef SIMPLE_OPT_RESPONSE_FILE_DEPTH
+#define SIMPLE_OPT_RESPONSE_FILE_DEPTH 16
+#endif
+
+/* the size of the chunks a simple_opt_arena grows by, once its seed buffer is
+ * full */
+#ifndef SIMPLE_OPT_ARENA_CHUNK_SIZE
+#define SIMPLE_OPT_ARENA_CHUNK_SIZE 65536
+#endif
+
+/* the number of widths for which simple_opt_help keeps rendered output */
+#ifndef SIMPLE_OPT_HELP_CACHE_SIZE
+#define SIMPLE_OPT_HELP_CACHE_SIZE 4
+#endif
+
+/* passed as the first argument, these have simple_opt_complete answer a shell
+ * completion query, or print a completion script, and exit */
+#ifndef SIMPLE_OPT_COMPLETE_ARG
+#define SIMPLE_OPT_COMPLETE_ARG "--simple-opt-complete"
+#endif
+
+#ifndef SIMPLE_OPT_COMPLETION_SCRIPT_ARG
+#define SIMPLE_OPT_COMPLETION_SCRIPT_ARG "--simple-opt-completion-script"
+#endif
+
+/* INT, UNSIGNED and DOUBLE arguments are parsed by built-in parsers, which
+ * accept exactly what strtol, strtoul and strtod do in the "C" locale, whatever
+ * the current one, and leave errno as it was. the DOUBLE arguments they can't
+ * compute exactly are still handed to strtod, with any "." swapped for the
+ * locale's decimal point. define SIMPLE_OPT_LIBC_NUMBERS to parse them with
+ * strto* instead, in the current locale */
+
+/* the built-in DOUBLE parser computes values exactly only when doubles are
+ * evaluated at their own precision. otherwise it defers to strtod */
+#if !defined(SIMPLE_OPT_LIBC_NUMBERS) && defined(FLT_EVAL_METHOD) \
+		&& FLT_EVAL_METHOD == 0
+#define SUB_SIMPLE_OPT_EXACT_DOUBLE
+#endif
+
+/* long options may be abbreviated on the cli to any prefix of their name which
+ * no other long name shares ("--verb" for "--verbose"). define
+ * SIMPLE_OPT_EXACT_LONG_NAMES to accept only names in full */
+
+/* if SIMPLE_OPT_STATS is defined, parsing counts what it does and how long it
+ * takes into simple_opt_stats. otherwise the counting compiles to nothing */
+
 /* an internal print buffer width for usage printing. you shouldn't have to
  * worry about this if you're sane */
 #ifndef SIMPLE_OPT_PRINT_BUFFER_WIDTH
 #define SIMPLE_OPT_PRINT_BUFFER_WIDTH 2048
 #endif
 
+/* everything here is static, and most programs will only call a few of the
+ * functions defined. mark the rest so that compilers don't complain */
+#if defined(__GNUC__) || defined(__clang__)
+#define SIMPLE_OPT_UNUSED __attribute__((unused))
+#else
+#define SIMPLE_OPT_UNUSED
+#endif
+
 enum simple_opt_type {
 	SIMPLE_OPT_FLAG,
 	SIMPLE_OPT_BOOL,
@@ -39,9 +158,89 @@ enum simple_opt_type {
 	SIMPLE_OPT_CHAR,
 	SIMPLE_OPT_STRING,
 	SIMPLE_OPT_STRING_SET,
+	SIMPLE_OPT_INT_LIST,
+	SIMPLE_OPT_UNSIGNED_LIST,
+	SIMPLE_OPT_DOUBLE_LIST,
+	SIMPLE_OPT_STRING_LIST,
 	SIMPLE_OPT_END,
 };
 
+/* where an option's value came from, in increasing order of precedence. a
+ * value is only replaced by one from a source of at least the same precedence,
+ * so sources may be parsed in any order */
+enum simple_opt_source {
+	SIMPLE_OPT_SOURCE_DEFAULT,
+	SIMPLE_OPT_SOURCE_CONFIG,
+	SIMPLE_OPT_SOURCE_ENV,
+	SIMPLE_OPT_SOURCE_CLI,
+};
+
+/* a string argument, pointing into the argv it was passed in, or into the
+ * response file or snapshot it was read from */
+struct simple_opt_string {
+	const char *str;
+	size_t len;
+};
+
+struct simple_opt_arena_chunk {
+	struct simple_opt_arena_chunk *next;
+	size_t size;
+};
+
+/* memory for everything a parse produces, taken from a caller's buffer and
+ * then from chunks of the heap. resetting it keeps the chunks, so parsing the
+ * same sort of cli again allocates nothing */
+struct simple_opt_arena {
+	/* the block being allocated from */
+	char *block;
+	size_t used;
+	size_t size;
+
+	char *seed;
+	size_t seed_size;
+
+	/* every chunk allocated, in order, and the one in use (NULL while the
+	 * seed is) */
+	struct simple_opt_arena_chunk *chunks;
+	struct simple_opt_arena_chunk *cur;
+
+	/* the minimum size of a new chunk. if 0, the arena never grows */
+	size_t chunk_size;
+};
+
+/* the values of a list option, in the order they were passed. items is
+ * allocated by parsing, from arena if it isn't NULL, and otherwise from the
+ * heap, to be freed by simple_opt_lists_free */
+struct simple_opt_list {
+	union {
+		long *v_int;
+		unsigned long *v_unsigned;
+		double *v_double;
+		char **v_string;
+		void *p;
+	} items;
+	size_t count;
+	size_t cap;
+	struct simple_opt_arena *arena;
+};
+
+/* the value parsing assigns an option, as given by its type */
+union simple_opt_val {
+	bool v_bool;
+	long v_int;
+	unsigned long v_unsigned;
+	double v_double;
+	char v_char;
+#ifdef SIMPLE_OPT_STRING_REF
+	struct simple_opt_string v_string;
+#else
+	char v_string[SIMPLE_OPT_OPT_ARG_MAX_WIDTH];
+#endif
+	int v_string_set_idx;
+	struct simple_opt_list v_list;
+	unsigned long v_count;
+};
+
 struct simple_opt {
 	enum simple_opt_type type;
 	const char short_name;
@@ -58,19 +257,42 @@ struct simple_opt {
 	 * string possibilities against which an option's argument is matched */
 	const char **string_set;
 
+	/* optional, for type SIMPLE_OPT_STRING_SET, whether the case of ascii
+	 * letters is ignored when matching against string_set */
+	bool string_set_nocase;
+
+	/* optional, an environment variable which simple_opt_parse_env reads
+	 * this option from */
+	const char *env_name;
+
 	/* values assigned upon successful option parse */
 	bool was_seen;
 	bool arg_is_stored;
+	enum simple_opt_source source;
+	union simple_opt_val val;
+};
 
-	union {
-		bool v_bool;
-		long v_int;
-		unsigned long v_unsigned;
-		double v_double;
-		char v_char;
-		char v_string[SIMPLE_OPT_OPT_ARG_MAX_WIDTH];
-		int v_string_set_idx;
-	} val;
+/* as union simple_opt_val, but a string is always kept by reference, so
+ * that a value stays small */
+union simple_opt_value_val {
+	bool v_bool;
+	long v_int;
+	unsigned long v_unsigned;
+	double v_double;
+	char v_char;
+	struct simple_opt_string v_string;
+	int v_string_set_idx;
+	struct simple_opt_list v_list;
+	unsigned long v_count;
+};
+
+/* the values assigned to an option by simple_opt_parse_values, kept apart
+ * from the options themselves so that those can be const and shared */
+struct simple_opt_value {
+	bool was_seen;
+	bool arg_is_stored;
+	enum simple_opt_source source;
+	union simple_opt_value_val val;
 };
 
 enum simple_opt_result_type {
@@ -78,9 +300,15 @@ enum simple_opt_result_type {
 	SIMPLE_OPT_RESULT_UNRECOGNISED_OPTION,
 	SIMPLE_OPT_RESULT_BAD_ARG,
 	SIMPLE_OPT_RESULT_MISSING_ARG,
+	SIMPLE_OPT_RESULT_AMBIGUOUS_OPTION,
+	SIMPLE_OPT_RESULT_UNRECOGNISED_COMMAND,
 	SIMPLE_OPT_RESULT_OPT_ARG_TOO_LONG,
 	SIMPLE_OPT_RESULT_TOO_MANY_ARGS,
 	SIMPLE_OPT_RESULT_MALFORMED_OPTION_STRUCT,
+	SIMPLE_OPT_RESULT_OUT_OF_MEMORY,
+	SIMPLE_OPT_RESULT_BAD_RESPONSE_FILE,
+	SIMPLE_OPT_RESULT_BAD_CONFIG_FILE,
+	SIMPLE_OPT_RESULT_BAD_SNAPSHOT,
 };
 
 struct simple_opt_result {
@@ -93,749 +321,4286 @@ struct simple_opt_result {
 	char *argv[SIMPLE_OPT_MAX_ARGC];
 };
 
-static struct simple_opt_result simple_opt_parse(int argc, char **argv,
-		struct simple_opt *options);
+/* a response file or config file which was read while parsing. it stays
+ * loaded, as parsed values may point into it, until
+ * simple_opt_result_into_free */
+struct simple_opt_response_file {
+	struct simple_opt_response_file *next;
+	char *buf;
+	size_t size;
+	bool is_mapped;
+};
 
-static void simple_opt_print_usage(FILE *f, unsigned width,
-		char *command_name, char *command_options, char *command_summary,
-		struct simple_opt *options);
+/* the result of simple_opt_parse_into. rather than being copied, strings point
+ * into the argv which was parsed, and non-option arguments are stored wherever
+ * the caller chooses, so there's no limit to their number */
+struct simple_opt_result_into {
+	enum simple_opt_result_type result_type;
+	enum simple_opt_type option_type;
+	struct simple_opt *option;
 
-static void simple_opt_print_error(FILE *f, unsigned width, char *command_name,
-		struct simple_opt_result result);
+	/* where the option which caused an error was given, and for a config
+	 * file, its path and the line (from 1) */
+	enum simple_opt_source source;
+	const char *file;
+	unsigned long line;
+
+	/* the option which caused an error. not NUL-terminated at
+	 * option_string_len, as it may be followed by "=arg" */
+	const char *option_string;
+	size_t option_string_len;
+	const char *argument_string;
+
+	/* set argv to an array of argv_cap pointers before parsing to have
+	 * non-options stored there. if argv is NULL, they're instead moved, in
+	 * order, down the argv being parsed, starting at its second element, and
+	 * argv is left NULL */
+	int argc;
+	char **argv;
+	int argv_cap;
 
+	/* response files and config files read during parsing */
+	struct simple_opt_response_file *response_files;
 
-/* 
- * internal definitions
- *
- */
+	/* if set, everything parsing allocates comes from here instead of the
+	 * heap, and lives until it's reset */
+	struct simple_opt_arena *arena;
+};
 
-static bool sub_simple_opt_parse(struct simple_opt *o, char *s)
-{
-	unsigned i, j;
-	char *str, *cp;
-	bool match;
+/* one of the command lines parsed by simple_opt_parse_batch. values must
+ * have room for a value for each of the index's options, and result is
+ * filled in as by simple_opt_parse_values */
+struct simple_opt_batch_slot {
+	int argc;
+	char **argv;
+	struct simple_opt_value *values;
+	struct simple_opt_result_into result;
+};
 
-	switch (o->type) {
-	case SIMPLE_OPT_BOOL:
-		goto loop;
-strmatch:
-		for (j = 0; j < strlen(str); j++) {
-			if (s[j] == '\0' || tolower(s[j]) != str[j]) {
-				match = false;
-				goto strmatch_out;
-			}
-		}
+/* a word within a string, for word-wrapping */
+struct simple_opt_help_word {
+	uint32_t start;
+	uint32_t len;
+};
 
-		match = true;
-		goto strmatch_out;
-loop:
-		for (i = 0; i < 6; i++) {
-			switch (i) {
-			case 0:
-				str = "true";
-				goto strmatch;
-			case 1:
-				str = "yes";
-				goto strmatch;
-			case 2:
-				str = "on";
-				goto strmatch;
-			case 3:
-				str = "false";
-				goto strmatch;
-			case 4:
-				str = "no";
-				goto strmatch;
-			case 5:
-				str = "off";
-				goto strmatch;
-			}
-strmatch_out:
-			if (match) {
-				if (i < 3)
-					o->val.v_bool = true;
-				else
-					o->val.v_bool = false;
+/* a string to be word-wrapped during usage printing, along with the words
+ * it's made of, if they're known */
+struct simple_opt_help_text {
+	const char *s;
+	const struct simple_opt_help_word *words;
+	uint32_t nwords;
+};
 
-				return true;
-			}
-		}
+/* a usage message laid out in advance by simple_opt_help_init, so that it
+ * can be rendered at any width without revisiting the options, and rendered
+ * output cached for the most recent widths */
+struct simple_opt_help {
+	struct simple_opt *options;
+	struct simple_opt_help_text command_name;
+	size_t command_name_len;
+	struct simple_opt_help_text command_options;
+	struct simple_opt_help_text command_summary;
+
+	/* three per option: short name, long name / type, and description */
+	struct simple_opt_help_text *rows;
+	int count;
+	unsigned desc_line_start;
+
+	/* the text of generated columns, and the words of everything */
+	char *text;
+	struct simple_opt_help_word *words;
+
+	struct {
+		unsigned width;
+		char *s;
+		size_t len;
+	} cache[SIMPLE_OPT_HELP_CACHE_SIZE];
+	unsigned cache_next;
+};
 
-		return false;
+struct simple_opt_index_slot {
+	uint32_t hash;
+	uint32_t len;
+	int opt;
+};
 
+/* an open-addressed hash table of one STRING_SET option's strings, in which
+ * each slot's opt is the string's index in string_set */
+struct simple_opt_index_set {
+	struct simple_opt_index_slot *table;
+	uint32_t mask;
+};
 
-	case SIMPLE_OPT_INT:
-		errno = 0;
-		o->val.v_int = strtol(s, &cp, 0);
+/* a lookup index compiled once from an options array, so that identifying an
+ * option on the cli costs a table lookup rather than a scan of every option */
+struct simple_opt_index {
+	const struct simple_opt *options;
+	int count;
+
+	/* the option with each short_name, or -1 */
+	int short_table[256];
+
+	/* open-addressed hash table of long names, with their lengths cached.
+	 * long_mask + 1 slots, always a power of two */
+	struct simple_opt_index_slot *long_table;
+	uint32_t long_mask;
+
+	/* the options with long names, sorted by name, so that an abbreviated
+	 * name can be found by binary search */
+	const struct simple_opt **long_sorted;
+	int long_count;
+
+	/* a table for each option, built for those of type STRING_SET, so that
+	 * their arguments are matched in constant time however many strings
+	 * they have */
+	struct simple_opt_index_set *sets;
+
+	/* the options array was checked for malformed and duplicate options
+	 * while building the index, so parsing needn't check it again */
+	bool validated;
+};
 
-		if (cp == s || *cp != '\0' || errno)
-			return false;
+/* a command with options of its own, which may have subcommands, each of
+ * which is named by the first non-option argument after it. the program
+ * itself, with its global options, is the root of a tree of these */
+struct simple_opt_command {
+	const char *name;
 
-		return true;
+	/* optional, a description of the command used for usage printing */
+	const char *description;
 
-	case SIMPLE_OPT_UNSIGNED:
-		if (s[0] == '-' || s[0] == '+')
-			return false;
+	struct simple_opt *options;
 
-		errno = 0;
-		o->val.v_unsigned = strtoul(s, &cp, 0);
+	/* optional, an array of subcommands, ending in one with a NULL name */
+	struct simple_opt_command *subcommands;
 
-		if (cp == s || *cp != '\0' || errno)
-			return false;
+	/* set when the command is named on the cli */
+	bool was_seen;
 
-		return true;
+	/* the command's options are compiled the first time it's parsed, so
+	 * the commands which aren't used cost nothing */
+	bool is_compiled;
+	struct simple_opt_index idx;
+};
 
-	case SIMPLE_OPT_DOUBLE:
-		errno = 0;
-		o->val.v_double = strtod(s, &cp);
+/* a cli argument, along with its length and the offset of its first "=" (or
+ * its length if it has none), found in a single pass over it as it's read */
+struct sub_simple_opt_token {
+	char *s;
+	size_t len;
+	size_t eq;
+};
 
-		if (cp == s || *cp != '\0' || errno)
-			return false;
+/* the stream of cli arguments being parsed. this is normally just argv, but
+ * with SIMPLE_OPT_RESPONSE_FILES defined any "@file" argument is replaced by
+ * the arguments read from that file */
+struct sub_simple_opt_stream {
+	int argc;
+	char **argv;
+	int i;
 
-		return true;
+	/* the next argument, if it's been peeked at */
+	struct sub_simple_opt_token peeked;
+
+	/* whether "@file" arguments are expanded */
+	bool expand;
+
+	/* set, along with error_string, if reading a response file failed.
+	 * error_detail says what was wrong with a file which could be read */
+	enum simple_opt_result_type error;
+	char *error_string;
+	const char *error_detail;
+
+	/* the read position and end of each response file being read, and the
+	 * "@file" argument which named it */
+	int depth;
+	char *file_pos[SIMPLE_OPT_RESPONSE_FILE_DEPTH];
+	char *file_end[SIMPLE_OPT_RESPONSE_FILE_DEPTH];
+	char *file_arg[SIMPLE_OPT_RESPONSE_FILE_DEPTH];
+
+	/* response files are loaded into arena, if it's set, and otherwise
+	 * added to files */
+	struct simple_opt_response_file **files;
+	struct simple_opt_arena *arena;
+};
 
-	case SIMPLE_OPT_CHAR:
-		if (strlen(s) == 2 && s[0] == '\\') {
-			switch (s[1]) {
-			case '0':
-				o->val.v_char = '\0';
-				break;
-			case 'a':
-				o->val.v_char = '\a';
-				break;
-			case 'b':
-				o->val.v_char = '\b';
-				break;
-			case 't':
-				o->val.v_char = '\t';
-				break;
-			case 'n':
-				o->val.v_char = '\n';
-				break;
-			case 'v':
-				o->val.v_char = '\v';
-				break;
-			case 'f':
-				o->val.v_char = '\f';
-				break;
-			case 'r':
-				o->val.v_char = '\r';
-				break;
-			case '\\':
-				o->val.v_char = '\\';
-				break;
-			default:
-				return false;
-			}
-			return true;
-		} else if (strlen(s) != 1) {
-			return false;
-		}
+enum simple_opt_event {
+	SIMPLE_OPT_EVENT_OPTION,
+	SIMPLE_OPT_EVENT_ARG,
+	SIMPLE_OPT_EVENT_END,
+	SIMPLE_OPT_EVENT_ERROR,
+};
 
-		o->val.v_char = s[0];
-		return true;
+/* an iterator over the cli, for parsing one option or non-option argument at a
+ * time with simple_opt_next */
+struct simple_opt_iter {
+	struct simple_opt *options;
+	const struct simple_opt_index *idx;
 
-	case SIMPLE_OPT_STRING:
-		if (strlen(s) + 1 >= SIMPLE_OPT_OPT_ARG_MAX_WIDTH)
-			return false;
+	/* where values are kept, if not in options */
+	struct simple_opt_value *values;
 
-		strcpy(o->val.v_string, s);
-		return true;
+	/* the last event returned by simple_opt_next, and the option and/or
+	 * argument it relates to */
+	enum simple_opt_event event;
+	struct simple_opt *option;
+	char *arg;
 
-	case SIMPLE_OPT_STRING_SET:
-		for (i = 0; o->string_set[i] != NULL; i++) {
-			if (!strcmp(s, o->string_set[i])) {
-				o->val.v_string_set_idx = i;
-				return true;
-			}
-		}
+	/* details of any error, as they would be for simple_opt_parse_into */
+	struct simple_opt_result_into result;
 
-		return false;
+	struct simple_opt_result_into *r;
+	struct sub_simple_opt_stream st;
+	bool after_marker;
+	bool started;
 
-	default:
-		return false;
-	}
-}
+	/* the rest of a bundle of short options ("-abc") still to be read, and
+	 * the argument it's part of */
+	char *bundle;
+	struct sub_simple_opt_token bundle_arg;
 
-static int sub_simple_opt_id(char *s, struct simple_opt *o)
-{
-	int i;
-	char c;
+	/* short option lookup when parsing without an index, built the first
+	 * time a bundle is seen */
+	bool short_table_built;
+	int short_table[256];
+};
 
-	if (strlen(s) < 2)
-		return -1;
+#ifdef SIMPLE_OPT_STATS
+/* counts of what parsing has done, accumulated across parses until
+ * simple_opt_stats_reset. times are in nanoseconds */
+struct simple_opt_stats {
+	unsigned long parses;
+	unsigned long lookups;
+	unsigned long string_compares;
+	unsigned long lookaheads;
+	unsigned long conversions[SIMPLE_OPT_END];
+	unsigned long conversion_failures;
+	uint64_t validate_ns;
+	uint64_t loop_ns;
+};
 
-	if (s[1] != '-') {
-		if (strlen(s) > 2)
-			return -1;
+static SIMPLE_OPT_UNUSED struct simple_opt_stats simple_opt_stats;
+
+/* simple_opt_parse_batch's threads count into the same stats at once, so with
+ * SIMPLE_OPT_THREADS they're added to atomically */
+#if defined(SIMPLE_OPT_THREADS) && defined(__GNUC__)
+#define SUB_SIMPLE_OPT_STAT_ADD(field, n) \
+	((void)__atomic_fetch_add(&simple_opt_stats.field, (n), __ATOMIC_RELAXED))
+#elif defined(SIMPLE_OPT_THREADS)
+#error "SIMPLE_OPT_STATS with SIMPLE_OPT_THREADS needs gcc or clang atomics"
+#else
+#define SUB_SIMPLE_OPT_STAT_ADD(field, n) ((void)(simple_opt_stats.field += (n)))
+#endif
 
-		for (i = 0; o[i].type != SIMPLE_OPT_END; i++) {
-			if (s[1] == o[i].short_name)
-				return i;
-		}
+#define SUB_SIMPLE_OPT_STAT(field) SUB_SIMPLE_OPT_STAT_ADD(field, 1)
+#else
+#define SUB_SIMPLE_OPT_STAT(field) ((void)0)
+#endif
 
-		return -1;
-	}
+static struct simple_opt_result simple_opt_parse(int argc, char **argv,
+		struct simple_opt *options);
 
-	for (i = 0; o[i].type != SIMPLE_OPT_END; i++) {
-		if ( o[i].long_name != NULL && !strncmp(s + 2, o[i].long_name, strlen(o[i].long_name)) ) {
-			c = s[2 + strlen(o[i].long_name)];
-			if (c == '\0' || c == '=')
-				return i;
-		}
-	}
+static SIMPLE_OPT_UNUSED bool simple_opt_index_init(
+		struct simple_opt_index *idx, const struct simple_opt *options);
 
-	return -1;
-}
+static SIMPLE_OPT_UNUSED void simple_opt_index_free(
+		struct simple_opt_index *idx);
 
-static struct simple_opt_result simple_opt_parse(int argc, char **argv,
-		struct simple_opt *options)
-{
-	int i, j, opt_i;
-	int arg_end;
-	char c;
-	char *s;
-	struct simple_opt_result r;
+static SIMPLE_OPT_UNUSED enum simple_opt_result_type simple_opt_validate(
+		const struct simple_opt *options);
 
-	/* check for malformed options */
-	for (i = 0; options[i].type != SIMPLE_OPT_END; i++) {
-		if ( (options[i].short_name == '\0' && options[i].long_name == NULL) 
-				|| (options[i].type == SIMPLE_OPT_FLAG &&
-					options[i].arg_is_required) 
-				|| (options[i].type == SIMPLE_OPT_STRING_SET &&
-					options[i].string_set == NULL) ) {
-			r.result_type = SIMPLE_OPT_RESULT_MALFORMED_OPTION_STRUCT;
-			goto end;
-		}
-	}
+static SIMPLE_OPT_UNUSED enum simple_opt_result_type simple_opt_compile(
+		struct simple_opt_index *idx, const struct simple_opt *options);
 
-	/* check for duplicate options. can't modify anything so this is going to
-	 * be pretty not-optimised, but ah well */
-	for (i = 0; options[i].type != SIMPLE_OPT_END; i++) {
-		for (j = 0; options[j].type != SIMPLE_OPT_END; j++) {
-			if (i != j && (
-						( options[i].short_name != '\0'
-						&& options[j].short_name != '\0'
-						&& options[i].short_name == options[j].short_name)
-					|| ( options[i].long_name != NULL
-						&& options[j].long_name != NULL
-						&& !strcmp(options[i].long_name, options[j].long_name))
-					)
-				) {
-				r.result_type = SIMPLE_OPT_RESULT_MALFORMED_OPTION_STRUCT;
-				goto end;
-			}
-		}
-	}
+static SIMPLE_OPT_UNUSED struct simple_opt_result simple_opt_parse_index(
+		int argc, char **argv, struct simple_opt_index *idx);
 
-	r.argc = 0;
+static SIMPLE_OPT_UNUSED enum simple_opt_result_type simple_opt_parse_into(
+		int argc, char **argv, struct simple_opt *options,
+		struct simple_opt_result_into *r);
 
-	r.result_type = SIMPLE_OPT_RESULT_SUCCESS;
+static SIMPLE_OPT_UNUSED enum simple_opt_result_type
+simple_opt_parse_index_into(int argc, char **argv,
+		struct simple_opt_index *idx, struct simple_opt_result_into *r);
 
-	for (i = 1; i < argc; i++) {
-		/* "following are non-opts" marker */
-		if ( !strcmp(argv[i], "--") ) {
-			i++;
-			break;
-		}
+static SIMPLE_OPT_UNUSED enum simple_opt_result_type simple_opt_parse_values(
+		int argc, char **argv, const struct simple_opt *options,
+		struct simple_opt_value *values, struct simple_opt_result_into *r);
 
-		/* if not an opt, add to r.argv */
-		if (argv[i][0] != '-') {
+static SIMPLE_OPT_UNUSED enum simple_opt_result_type
+simple_opt_parse_index_values(int argc, char **argv,
+		const struct simple_opt_index *idx, struct simple_opt_value *values,
+		struct simple_opt_result_into *r);
 
-			if (r.argc + 1 > SIMPLE_OPT_MAX_ARGC) {
-				r.result_type = SIMPLE_OPT_RESULT_TOO_MANY_ARGS;
-				goto end;
-			}
+static SIMPLE_OPT_UNUSED void simple_opt_values_free(
+		const struct simple_opt *options, struct simple_opt_value *values);
 
-			r.argv[r.argc] = argv[i];
-			r.argc++;
-			continue;
-		}
+static SIMPLE_OPT_UNUSED enum simple_opt_result_type simple_opt_parse_command(
+		int argc, char **argv, struct simple_opt_command *root,
+		struct simple_opt_command **command,
+		struct simple_opt_result_into *r);
 
-		/* unrecognised argument */
-		if (strlen(argv[i]) < 2) {
-			r.result_type = SIMPLE_OPT_RESULT_UNRECOGNISED_OPTION;
-			goto opt_copy_and_return;
-		}
+static SIMPLE_OPT_UNUSED void simple_opt_command_free(
+		struct simple_opt_command *command);
 
-		/* identify this option */
-		opt_i = sub_simple_opt_id(argv[i], options);
+static SIMPLE_OPT_UNUSED size_t simple_opt_parse_batch(
+		const struct simple_opt_index *idx,
+		struct simple_opt_batch_slot *slots, size_t count, int threads);
 
-		if (opt_i == -1) {
-			r.result_type = SIMPLE_OPT_RESULT_UNRECOGNISED_OPTION;
-			goto opt_copy_and_return;
-		}
+static SIMPLE_OPT_UNUSED enum simple_opt_result_type simple_opt_parse_env(
+		struct simple_opt *options, const char *prefix, char **envp,
+		struct simple_opt_result_into *r);
 
-		options[opt_i].was_seen = true;
+static SIMPLE_OPT_UNUSED enum simple_opt_result_type simple_opt_parse_config(
+		struct simple_opt *options, const char *path,
+		struct simple_opt_result_into *r);
 
-		if (options[opt_i].type == SIMPLE_OPT_FLAG)
-			continue;
+static SIMPLE_OPT_UNUSED size_t simple_opt_serialize(
+		const struct simple_opt *options, void *buf, size_t size);
 
-		/* if there's an arg, is it a separate element in argv? or is it passed
-		 * as "--X=arg"? */
-		if (argv[i][1] == '-')
-			c = argv[i][2 + strlen(options[opt_i].long_name)];
-		else
-			c = '\0';
+static SIMPLE_OPT_UNUSED enum simple_opt_result_type simple_opt_deserialize(
+		struct simple_opt *options, const void *buf, size_t size,
+		struct simple_opt_arena *arena);
 
-		/* if this option doesn't require an arg and none is to be found,
-		 * just continue */
-		if (!options[opt_i].arg_is_required && c == '\0') {
-			if (i + 1 >= argc)
-				continue;
+static SIMPLE_OPT_UNUSED void simple_opt_result_into_free(
+		struct simple_opt_result_into *r);
 
-			if (!strcmp(argv[i+1], "--"))
-				continue;
+static SIMPLE_OPT_UNUSED void simple_opt_lists_free(
+		struct simple_opt *options);
 
-			if (sub_simple_opt_id(argv[i+1], options) != -1)
-				continue;
-		}
+static SIMPLE_OPT_UNUSED void simple_opt_arena_init(
+		struct simple_opt_arena *a, void *buf, size_t size);
 
-		if (c == '\0') {
-			if (i + 1 >= argc) {
-				r.result_type = SIMPLE_OPT_RESULT_MISSING_ARG;
-				r.option_type = options[opt_i].type;
-				r.option = options + opt_i;
-				goto opt_copy_and_return;
-			}
-			s = argv[i+1];
-		} else {
-			if (argv[i][3 + strlen(options[opt_i].long_name)] == '\0') {
-				r.result_type = SIMPLE_OPT_RESULT_MISSING_ARG;
-				r.option_type = options[opt_i].type;
-				r.option = options + opt_i;
-				goto opt_copy_and_return;
-			}
+static SIMPLE_OPT_UNUSED void *simple_opt_arena_alloc(
+		struct simple_opt_arena *a, size_t size);
 
-			s = argv[i] + 3 + strlen(options[opt_i].long_name);
-		}
+static SIMPLE_OPT_UNUSED void simple_opt_arena_reset(
+		struct simple_opt_arena *a);
 
-		/* is there space for the arg (if this opt wants a string)? */
-		if (options[opt_i].type == SIMPLE_OPT_STRING
-				&& strlen(s) + 1 >= SIMPLE_OPT_OPT_ARG_MAX_WIDTH) {
-			r.result_type = SIMPLE_OPT_RESULT_OPT_ARG_TOO_LONG;
-			r.option_type = options[opt_i].type;
-			r.option = options + opt_i;
-			goto opt_copy_and_return;
-		}
+static SIMPLE_OPT_UNUSED void simple_opt_arena_free(
+		struct simple_opt_arena *a);
 
-		/* try to actually parse the thing */
-		if (sub_simple_opt_parse(&(options[opt_i]), s) ) {
-			options[opt_i].arg_is_stored = true;
-			/* skip forwards in argv if this wasn't an "="-type argument
-			 * passing */
-			if (i + 1 < argc && s == argv[i+1])
-				i++;
-		} else {
-			r.result_type = SIMPLE_OPT_RESULT_BAD_ARG;
-			r.option_type = options[opt_i].type;
-			strncpy(r.argument_string, s, SIMPLE_OPT_OPT_ARG_MAX_WIDTH - 1);
-			r.argument_string[SIMPLE_OPT_OPT_ARG_MAX_WIDTH - 1] = '\0';
-			r.option = options + opt_i;
-			goto opt_copy_and_return;
-		}
+static SIMPLE_OPT_UNUSED void simple_opt_iter_init(struct simple_opt_iter *it,
+		int argc, char **argv, struct simple_opt *options,
+		struct simple_opt_index *idx);
 
-		continue;
-	}
+static SIMPLE_OPT_UNUSED enum simple_opt_event simple_opt_next(
+		struct simple_opt_iter *it);
 
-	/* copy anything that follows -- into r.argv */
+static void simple_opt_print_usage(FILE *f, unsigned width,
+		char *command_name, char *command_options, char *command_summary,
+		struct simple_opt *options);
 
-	for (; i < argc; i++, r.argc++)
-		r.argv[r.argc] = argv[i];
+static void simple_opt_print_error(FILE *f, unsigned width, char *command_name,
+		struct simple_opt_result result);
 
-end:
+static SIMPLE_OPT_UNUSED void simple_opt_print_error_into(FILE *f,
+		unsigned width, char *command_name,
+		const struct simple_opt_result_into *result);
 
-	return r;
+static SIMPLE_OPT_UNUSED size_t simple_opt_render_usage(char *buf, size_t len,
+		unsigned width, char *command_name, char *command_options,
+		char *command_summary, struct simple_opt *options);
 
-opt_copy_and_return:
-	for(arg_end = 0; argv[i][arg_end] != '=' && argv[i][arg_end] != '\0';
-			arg_end++);
+static SIMPLE_OPT_UNUSED void simple_opt_print_command_usage(FILE *f,
+		unsigned width, char *command_name, char *command_options,
+		struct simple_opt_command *command);
 
-	strncpy(r.option_string, argv[i], SIMPLE_OPT_OPT_MAX_WIDTH - 1 < arg_end ?
-			SIMPLE_OPT_OPT_MAX_WIDTH - 1 : arg_end);
+static SIMPLE_OPT_UNUSED size_t simple_opt_render_command_usage(char *buf,
+		size_t len, unsigned width, char *command_name, char *command_options,
+		struct simple_opt_command *command);
 
-	r.option_string[SIMPLE_OPT_OPT_MAX_WIDTH - 1 < arg_end ?
-		SIMPLE_OPT_OPT_MAX_WIDTH -1 : arg_end] = '\0';
+static SIMPLE_OPT_UNUSED enum simple_opt_result_type simple_opt_help_init(
+		struct simple_opt_help *h, char *command_name, char *command_options,
+		char *command_summary, struct simple_opt *options);
 
-	goto end;
-}
+static SIMPLE_OPT_UNUSED void simple_opt_help_free(struct simple_opt_help *h);
 
-static int sub_simple_opt_wrap_print(FILE *f, unsigned width, unsigned col,
-		unsigned line_start, const char *s)
-{
-	bool add_newline = false, first_word = true, first_line = true;
-	unsigned i, j, word_start, word_end;
+static SIMPLE_OPT_UNUSED const char *simple_opt_help_render(
+		struct simple_opt_help *h, unsigned width, size_t *len);
 
-	if (width != 0 && line_start >= width) {
-		line_start = 0;
-		add_newline = true;
-	}
+static SIMPLE_OPT_UNUSED void simple_opt_help_print(FILE *f, unsigned width,
+		struct simple_opt_help *h);
 
-	if (width != 0 && col >= width)
-		add_newline = true;
+static SIMPLE_OPT_UNUSED size_t simple_opt_render_error(char *buf, size_t len,
+		unsigned width, char *command_name,
+		const struct simple_opt_result_into *result);
 
-	if (add_newline) {
-		fprintf(f, "\n");
-		col = 0;
-		first_line = false;
-	}
+static SIMPLE_OPT_UNUSED void simple_opt_complete(int argc, char **argv,
+		const struct simple_opt *options);
 
-	/* print out the message, trying to wrap at words */
-	word_start = 0;
-	while (1) {
-		/* find the next word */
-		while ( isspace(s[word_start]) )
-			word_start++;
+static SIMPLE_OPT_UNUSED void simple_opt_complete_index(int argc, char **argv,
+		const struct simple_opt_index *idx);
 
-		/* null appeared before any non-spaces */
-		if (s[word_start] == '\0')
-			return col;
+static SIMPLE_OPT_UNUSED bool simple_opt_print_completion_script(FILE *f,
+		const char *shell, const char *command_name,
+		const struct simple_opt *options);
 
-		word_end = word_start;
-		while ( (s[word_end] != '\0') && !isspace(s[word_end]) )
-			word_end++;
+#ifdef SIMPLE_OPT_STATS
+static SIMPLE_OPT_UNUSED void simple_opt_stats_reset(void);
+#endif
 
-		/* buffer up to line_start with spaces */
-		while (col < line_start + 2 * (!first_line && width > 40
-					&& line_start > 5)) {
-			fprintf(f, " ");
-			col++;
+
+/* 
+ * internal definitions
+ *
+ */
+
+/* the alignment given to every arena allocation */
+union sub_simple_opt_align {
+	long double ld;
+	long long ll;
+	void *p;
+	void (*fp)(void);
+};
+
+static void simple_opt_arena_init(struct simple_opt_arena *a, void *buf,
+		size_t size)
+{
+	a->seed = (char *)buf;
+	a->seed_size = buf != NULL ? size : 0;
+	a->chunks = NULL;
+	a->chunk_size = SIMPLE_OPT_ARENA_CHUNK_SIZE;
+
+	simple_opt_arena_reset(a);
+}
+
+static void *simple_opt_arena_alloc(struct simple_opt_arena *a, size_t size)
+{
+	const size_t align = sizeof(union sub_simple_opt_align);
+	/* chunk headers are padded so that their data starts aligned */
+	const size_t header = (sizeof(struct simple_opt_arena_chunk) + align - 1)
+		/ align * align;
+	struct simple_opt_arena_chunk *next;
+	size_t pad, n;
+	char *p;
+
+	while (1) {
+		if (a->block != NULL) {
+			pad = (align - (size_t)((uintptr_t)(a->block + a->used) % align))
+				% align;
+			if (a->size - a->used >= pad && a->size - a->used - pad >= size)
+				break;
 		}
 
-		/* if too little space left, wrap */
-		if (width != 0 && col + (word_end - word_start) + (first_word ? 0 : 1)
-				> width && first_word == false) {
-			fprintf(f, "\n");
-			first_line = false;
-			/* buffer up to line_start with spaces */
-			col = 0;
-			while (col < line_start + 2 * (!first_line && width > 40
-						&& line_start > 5)) {
-				fprintf(f, " ");
-				col++;
-			}
-			first_word = true;
-		} 
-		
-		if (first_word == false) {
-			fprintf(f, " ");
-			col++;
+		/* move on to the next chunk, allocating it if this is as far as the
+		 * arena has grown */
+		next = a->cur != NULL ? a->cur->next : a->chunks;
+		if (next == NULL) {
+			if (a->chunk_size == 0 || size > (size_t)-1 - header)
+				return NULL;
+
+			n = size + header > a->chunk_size ? size + header : a->chunk_size;
+			next = (struct simple_opt_arena_chunk *)malloc(n);
+			if (next == NULL)
+				return NULL;
+
+			next->next = NULL;
+			next->size = n - header;
+
+			if (a->cur != NULL)
+				a->cur->next = next;
+			else
+				a->chunks = next;
 		}
 
-		/* if too long, print piecemeal */
-		if (width != 0 && (line_start + (word_end - word_start) > width
-					|| (first_word && col + (word_end - word_start) > width)) ) {
-			j = word_start;
-			while (1) {
-				for (i = 0; col < width && j < word_end; i++, j++) {
-					fprintf(f, "%c", s[j]);
-					col++;
-				}
+		a->cur = next;
+		a->block = (char *)next + header;
+		a->used = 0;
+		a->size = next->size;
+	}
 
-				if (j == word_end)
-					break;
+	p = a->block + a->used + pad;
+	a->used += pad + size;
 
-				col = 0;
-				fprintf(f, "\n");
-				first_line = false;
-				while (col < line_start + 2 * (!first_line && width > 40
-							&& line_start > 5)) {
-					fprintf(f, " ");
-					col++;
-				}
-			}
-		/* else just print and move to the next word */
-		} else {
-			for (i = 0; i < word_end - word_start; i++)
-				fprintf(f, "%c", s[word_start + i]);
+	return p;
+}
 
-			col += i;
-		}
+/* grow p, the last allocation made from a, in place if there's room */
+static void *sub_simple_opt_arena_grow(struct simple_opt_arena *a, void *p,
+		size_t old_size, size_t new_size)
+{
+	void *q;
 
-		word_start = word_end;
-		first_word = false;
+	if (p != NULL && a->block != NULL
+			&& (char *)p + old_size == a->block + a->used
+			&& a->size - a->used >= new_size - old_size) {
+		a->used += new_size - old_size;
+		return p;
 	}
 
-	return col;
+	q = simple_opt_arena_alloc(a, new_size);
+	if (q != NULL && old_size > 0)
+		memcpy(q, p, old_size);
+
+	return q;
 }
 
-static void simple_opt_print_usage(FILE *f, unsigned width,
-		char *command_name, char *command_options, char *command_summary,
-		struct simple_opt *options)
+static void simple_opt_arena_reset(struct simple_opt_arena *a)
 {
-	char print_buffer[SIMPLE_OPT_PRINT_BUFFER_WIDTH];
-	unsigned i, j, col, print_buffer_offset, desc_line_start;
+	a->block = a->seed;
+	a->used = 0;
+	a->size = a->seed_size;
+	a->cur = NULL;
+}
 
-	/* calculate the required line_start for printing descriptions (leaving
-	 * space for the widest existing long-option) */
+static void simple_opt_arena_free(struct simple_opt_arena *a)
+{
+	struct simple_opt_arena_chunk *c;
 
-	/* check for space for column 1 (short_name) */
-	if (5 >= SIMPLE_OPT_PRINT_BUFFER_WIDTH) {
-		fprintf(f, "simple-opt internal err: print buffer too small\n");
-		return;
+	while (a->chunks != NULL) {
+		c = a->chunks;
+		a->chunks = c->next;
+		free(c);
 	}
 
-	/* 4 to start with, leaving space for "  -X " */
-	desc_line_start = 5;
+	simple_opt_arena_reset(a);
+}
 
-	/* check for space for column 2 (long_name / arg type) */
-	for (i = 0; options[i].type != SIMPLE_OPT_END; i++) {
-		j = 0;
+#ifdef SIMPLE_OPT_STATS
+/* a monotonic clock in nanoseconds, or the processor clock if there isn't
+ * one */
+static uint64_t sub_simple_opt_stats_ns(void)
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
 
-		/* 3 for "--" and "=" */
-		if (options[i].long_name != NULL)
-			j += 3 + strlen(options[i].long_name);
-
-		/* 2 for optional args, where arg is wrapped in [] */
-		if (!options[i].arg_is_required && options[i].type != SIMPLE_OPT_FLAG)
-			j += 2;
-
-		/* the width of the arg type string (BOOL, INT, UNSIGNED, STRING etc)
-		 * FLAGs don't take an argument, so 0 */
-		if (options[i].type != SIMPLE_OPT_FLAG) {
-			/* if there's a custom string, use that width. else, use one of the
-			 * default widths */
-			if (options[i].custom_arg_string != NULL) {
-				j += strlen(options[i].custom_arg_string);
-			} else {
-				switch (options[i].type) {
-				case SIMPLE_OPT_BOOL:
-					j += 4;
-					break;
-				case SIMPLE_OPT_INT:
-					j += 3;
-					break;
-				case SIMPLE_OPT_UNSIGNED:
-					j += 8;
-					break;
-				case SIMPLE_OPT_DOUBLE:
-					j += 6;
-					break;
-				case SIMPLE_OPT_CHAR:
-					j += 4;
-					break;
-				case SIMPLE_OPT_STRING:
-				case SIMPLE_OPT_STRING_SET:
-					j += 6;
-					break;
-				default:
-					break;
-				}
-			}
-		}
+	clock_gettime(CLOCK_MONOTONIC, &ts);
 
-		/* 5 for leading "  -X ", 2 for trailing " " */
-		if (desc_line_start < j + 5 + 2)
-			desc_line_start = j + 5 + 2;
-	}
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+	return (uint64_t)clock() * (1000000000 / CLOCKS_PER_SEC);
+#endif
+}
 
-	/* check for space for long_name printing */
-	if (desc_line_start - 5 - 2 >= SIMPLE_OPT_PRINT_BUFFER_WIDTH) {
-		fprintf(f, "simple-opt internal err: usage print buffer too small\n");
-		return;
-	}
+static void simple_opt_stats_reset(void)
+{
+	memset(&simple_opt_stats, 0, sizeof(simple_opt_stats));
+}
+#endif
 
-	/* if the desc_line_start is so far over it threatens readability, move it
-	 * back a bit and just let the offending longer args be offset */
-	if (desc_line_start > (width / 2 < 30 ? width / 2 : 30))
-		desc_line_start = (width / 2 < 30 ? width / 2 : 30);
+#ifndef SIMPLE_OPT_LIBC_NUMBERS
+static bool sub_simple_opt_is_space(char c)
+{
+	return c == ' ' || (c >= '\t' && c <= '\r');
+}
 
+/* the value of c as a digit in any base up to 16, or 16 if it isn't one */
+static unsigned sub_simple_opt_digit(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+
+	return 16;
+}
 
+/* parse the 8 characters at s as decimal digits, all at once. the word is
+ * assembled little-endian on any host, which compilers reduce to a single
+ * load where they can */
+static bool sub_simple_opt_digits8(const char *s, uint32_t *v)
+{
+	uint64_t w = 0;
+	int i;
 
-	/* 
-	 * printing 
-	 *
-	 */
+	for (i = 0; i < 8; i++)
+		w |= (uint64_t)(unsigned char)s[i] << (8 * i);
 
-	/* print "Usage: <exec> <options> */
-	if (command_name != NULL && command_options != NULL) {
-		col = sub_simple_opt_wrap_print(f, width, 0, 0, "Usage:");
+	/* every byte must be 0x30-0x39: its high nibble 3, and its low nibble
+	 * small enough that adding 6 doesn't carry out of it */
+	if ((w & UINT64_C(0xF0F0F0F0F0F0F0F0)) != UINT64_C(0x3030303030303030)
+			|| ((w + UINT64_C(0x0606060606060606))
+				& UINT64_C(0xF0F0F0F0F0F0F0F0))
+			!= UINT64_C(0x3030303030303030))
+		return false;
+
+	/* combine neighbouring digits into pairs, then pairs into fours, then
+	 * fours into the whole */
+	w -= UINT64_C(0x3030303030303030);
+	w = w * 10 + (w >> 8);
+	w = ((w & UINT64_C(0x000000FF000000FF))
+			* (100 + (UINT64_C(1000000) << 32))
+		+ ((w >> 16) & UINT64_C(0x000000FF000000FF))
+			* (1 + (UINT64_C(10000) << 32))) >> 32;
+
+	*v = (uint32_t)w;
+	return true;
+}
 
-		col = sub_simple_opt_wrap_print(f, width, col, 7, command_name);
+/* parse the unsigned part of an integer as strtoul(s, &cp, 0) would, failing
+ * if it isn't all of s or its value is over max */
+static bool sub_simple_opt_parse_magnitude(const char *s, uint64_t max,
+		uint64_t *v)
+{
+	size_t len, i = 0;
+	unsigned base = 10, d;
+	uint32_t chunk;
+	uint64_t n = 0;
+
+	len = strlen(s);
+
+	/* a 0x not followed by a hex digit is just a 0, followed by junk */
+	if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X')
+			&& sub_simple_opt_digit(s[2]) < 16) {
+		base = 16;
+		i = 2;
+	} else if (s[0] == '0') {
+		base = 8;
+	}
 
-		if (command_options != NULL)
-			sub_simple_opt_wrap_print(f, width, col,
-					7 + strlen(command_name) + 1, command_options);
+	if (i == len)
+		return false;
 
-		fprintf(f, "\n\n");
+	if (base == 10) {
+		for (; len - i >= 8 && sub_simple_opt_digits8(s + i, &chunk); i += 8) {
+			if (n > (max - chunk) / 100000000)
+				return false;
+			n = n * 100000000 + chunk;
+		}
 	}
 
-	/* print summary line */
-	if (command_summary != NULL) {
-		sub_simple_opt_wrap_print(f, width, 0, 2, command_summary);
-		fprintf(f, "\n\n");
+	for (; i < len; i++) {
+		d = sub_simple_opt_digit(s[i]);
+		if (d >= base || n > (max - d) / base)
+			return false;
+		n = n * base + d;
 	}
 
-	/* print option list */
-	for (i = 0; options[i].type != SIMPLE_OPT_END; i++) {
+	*v = n;
+	return true;
+}
 
-		/* print column 1 (short name) */
+static bool sub_simple_opt_parse_long(const char *s, long *v)
+{
+	bool neg = false;
+	uint64_t n;
 
-		if (options[i].short_name != '\0') {
-			if (sprintf(print_buffer, "-%c", options[i].short_name) < 0) {
-				fprintf(f, "\nsimple-opt internal err: encoding error printing"
-						"option %i\n", i);
-				return;
-			}
-		} else {
-			sprintf(print_buffer, "%c", '\0');
-		}
+	while ( sub_simple_opt_is_space(*s) )
+		s++;
 
-		col = sub_simple_opt_wrap_print(f, width, 0, 2, print_buffer);
+	if (*s == '-' || *s == '+')
+		neg = *s++ == '-';
 
-		/* print column 2 (long_name and type) */
-		sprintf(print_buffer, "%c", '\0');
-		print_buffer_offset = 0;
+	if (!sub_simple_opt_parse_magnitude(s,
+				neg ? (uint64_t)LONG_MAX + 1 : LONG_MAX, &n))
+		return false;
 
-		if (options[i].long_name != NULL) {
-			sprintf(print_buffer, "--");
-			print_buffer_offset = 2;
-
-			if (sprintf(print_buffer + print_buffer_offset, "%s",
-						options[i].long_name) < 0) {
-				fprintf(f, "\nsimple-opt internal err: encoding error printing"
-						"option %i\n", i);
-				return;
-			}
-			print_buffer_offset += strlen(options[i].long_name);
-		}
+	/* LONG_MIN's magnitude doesn't fit in a long */
+	if (neg)
+		*v = n == 0 ? 0 : -(long)(n - 1) - 1;
+	else
+		*v = (long)n;
+	return true;
+}
+
+static bool sub_simple_opt_parse_ulong(const char *s, unsigned long *v)
+{
+	bool neg = false;
+	uint64_t n;
+
+	while ( sub_simple_opt_is_space(*s) )
+		s++;
+
+	/* like strtoul, a negative value is negated as an unsigned long */
+	if (*s == '-' || *s == '+')
+		neg = *s++ == '-';
+
+	if (!sub_simple_opt_parse_magnitude(s, ULONG_MAX, &n))
+		return false;
 
-		if (!options[i].arg_is_required && options[i].type !=
-				SIMPLE_OPT_FLAG) {
-			sprintf(print_buffer + print_buffer_offset, "[");
-			print_buffer_offset++;
+	*v = neg ? -(unsigned long)n : (unsigned long)n;
+	return true;
+}
+
+/* strtod, as in the "C" locale and leaving errno as it was. where the locale's
+ * decimal point isn't ".", s is rejected if it has one, and is otherwise
+ * passed with its "." replaced by it */
+static bool sub_simple_opt_strtod(const char *s, double *v)
+{
+	char buf[64], *copy = (char *)s, *cp;
+	const char *point = localeconv()->decimal_point, *dot;
+	size_t len, point_len = strlen(point);
+	int saved_errno = errno;
+	bool ok;
+
+	if (point_len > 0 && strcmp(point, ".") != 0) {
+		if (strstr(s, point) != NULL)
+			return false;
+
+		dot = strchr(s, '.');
+		if (dot != NULL) {
+			len = strlen(s) - 1 + point_len;
+			copy = len < sizeof(buf) ? buf : (char *)malloc(len + 1);
+			if (copy == NULL)
+				return false;
+
+			memcpy(copy, s, dot - s);
+			memcpy(copy + (dot - s), point, point_len);
+			strcpy(copy + (dot - s) + point_len, dot + 1);
 		}
+	}
 
-		if (options[i].long_name != NULL && options[i].type != SIMPLE_OPT_FLAG) {
-			sprintf(print_buffer + print_buffer_offset, "=");
-			print_buffer_offset++;
+	errno = 0;
+	*v = strtod(copy, &cp);
+	ok = cp != copy && *cp == '\0' && !errno;
+	errno = saved_errno;
+
+	if (copy != s && copy != buf)
+		free(copy);
+
+	return ok;
+}
+
+/* decimal values with up to 19 significant digits whose mantissa and power of
+ * ten are both exactly representable as doubles (the large majority of what
+ * gets passed on a cli) are computed with a single correctly rounded multiply
+ * or divide. everything else (long mantissas, large exponents, hex, inf, nan)
+ * is left to strtod */
+static bool sub_simple_opt_parse_double(const char *s, double *v)
+{
+#ifdef SUB_SIMPLE_OPT_EXACT_DOUBLE
+	static const double pow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+	};
+#endif
+	const char *p = s;
+	bool neg = false, any = false, exact = true, exp_neg = false;
+	uint64_t m = 0;
+	int digits = 0, e = 0, exp = 0;
+	unsigned d;
+
+	while ( sub_simple_opt_is_space(*p) )
+		p++;
+
+	if (*p == '-' || *p == '+')
+		neg = *p++ == '-';
+
+	/* hex, inf and nan */
+	if ((p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+			|| *p == 'i' || *p == 'I' || *p == 'n' || *p == 'N')
+		goto libc;
+
+	/* the mantissa, ignoring leading zeros and any significant digits after
+	 * the first 19, other than to note they're there */
+	for (; (d = (unsigned char)*p - '0') < 10; p++) {
+		any = true;
+		if (digits < 19 && (m != 0 || d != 0)) {
+			m = m * 10 + d;
+			digits++;
+		} else if (digits >= 19) {
+			e++;
+			exact = exact && d == 0;
 		}
+	}
 
-		if (options[i].type != SIMPLE_OPT_FLAG) {
-			if (options[i].custom_arg_string != NULL) {
-				sprintf(print_buffer + print_buffer_offset,
-						"%s", options[i].custom_arg_string);
-				print_buffer_offset += strlen(options[i].custom_arg_string);
+	if (*p == '.') {
+		for (p++; (d = (unsigned char)*p - '0') < 10; p++) {
+			any = true;
+			if (digits < 19 && (m != 0 || d != 0)) {
+				m = m * 10 + d;
+				digits++;
+				e--;
+			} else if (digits < 19) {
+				e--;
 			} else {
-				switch (options[i].type) {
-				case SIMPLE_OPT_BOOL:
-					sprintf(print_buffer + print_buffer_offset, "BOOL");
-					print_buffer_offset += 4;
-					break;
-				case SIMPLE_OPT_INT:
-					sprintf(print_buffer + print_buffer_offset, "INT");
-					print_buffer_offset += 3;
-					break;
-				case SIMPLE_OPT_UNSIGNED:
-					sprintf(print_buffer + print_buffer_offset, "UNSIGNED");
-					print_buffer_offset += 8;
-					break;
-				case SIMPLE_OPT_DOUBLE:
-					sprintf(print_buffer + print_buffer_offset, "DOUBLE");
-					print_buffer_offset += 6;
-					break;
-				case SIMPLE_OPT_CHAR:
-					sprintf(print_buffer + print_buffer_offset, "CHAR");
-					print_buffer_offset += 4;
-					break;
-				case SIMPLE_OPT_STRING:
-				case SIMPLE_OPT_STRING_SET:
-					sprintf(print_buffer + print_buffer_offset, "STRING");
-					print_buffer_offset += 6;
-					break;
-				default:
-					break;
-				}
+				exact = exact && d == 0;
 			}
 		}
+	}
 
-		if (!options[i].arg_is_required && options[i].type !=
-				SIMPLE_OPT_FLAG)
-			sprintf(print_buffer + print_buffer_offset, "]");
-
-		/* 5 for "  -X --" */
-		col = sub_simple_opt_wrap_print(f, width, col, 5, print_buffer);
+	if (!any)
+		return false;
 
-		/* print option description */
-		if (options[i].description != NULL) {
-			if (col < width) {
-				fprintf(f, " ");
-				col++;
-			}
-			if (col < width) {
-				fprintf(f, " ");
-				col++;
-			}
-			sub_simple_opt_wrap_print(f, width, col, desc_line_start,
-					options[i].description);
+	/* an e without any digits after it isn't part of the number */
+	if ((*p == 'e' || *p == 'E') && ((d = (unsigned char)p[1] - '0') < 10
+				|| ((p[1] == '-' || p[1] == '+')
+					&& (unsigned)((unsigned char)p[2] - '0') < 10))) {
+		p++;
+		if (*p == '-' || *p == '+')
+			exp_neg = *p++ == '-';
+
+		for (; (d = (unsigned char)*p - '0') < 10; p++) {
+			if (exp < 100000)
+				exp = exp * 10 + d;
 		}
 
-		/* end of this option */
-		fprintf(f, "\n");
+		e += exp_neg ? -exp : exp;
+	}
+
+	if (*p != '\0')
+		return false;
+
+	if (m == 0) {
+		*v = neg ? -0.0 : 0.0;
+		return true;
+	}
+
+#ifdef SUB_SIMPLE_OPT_EXACT_DOUBLE
+	if (exact && m <= (UINT64_C(1) << 53)) {
+		/* shift any excess power of ten into m, if it still fits */
+		for (; e > 22 && m * 10 <= (UINT64_C(1) << 53); e--)
+			m *= 10;
+
+		if (e >= -22 && e <= 22) {
+			*v = e < 0 ? (double)m / pow10[-e] : (double)m * pow10[e];
+			if (neg)
+				*v = -*v;
+			return true;
+		}
 	}
+#endif
+
+libc:
+	return sub_simple_opt_strtod(s, v);
 }
+#else
+static bool sub_simple_opt_parse_long(const char *s, long *v)
+{
+	char *cp;
 
-static void simple_opt_print_error(FILE *f, unsigned width, char *command_name,
-		struct simple_opt_result result)
+	errno = 0;
+	*v = strtol(s, &cp, 0);
+
+	return cp != s && *cp == '\0' && !errno;
+}
+
+static bool sub_simple_opt_parse_ulong(const char *s, unsigned long *v)
 {
-	char print_buffer[SIMPLE_OPT_PRINT_BUFFER_WIDTH];
-	unsigned i, line_start, col;
-	int rval;
+	char *cp;
 
-	/* just easier to write */
-	const size_t size = SIMPLE_OPT_PRINT_BUFFER_WIDTH;
+	errno = 0;
+	*v = strtoul(s, &cp, 0);
 
-	if (result.result_type == SIMPLE_OPT_RESULT_SUCCESS)
-		return;
+	return cp != s && *cp == '\0' && !errno;
+}
 
-	if (command_name != NULL)
-		rval = snprintf(print_buffer, size, "%s:", command_name);
-	else
-		rval = snprintf(print_buffer, size, "err:");
+static bool sub_simple_opt_parse_double(const char *s, double *v)
+{
+	char *cp;
 
-	if (rval < 0 || (unsigned)rval >= size) {
-		fprintf(f, "simple-opt internal err: print buffer too small\n");
-		return;
-	}
+	errno = 0;
+	*v = strtod(s, &cp);
 
-	col = sub_simple_opt_wrap_print(f, width, 0, 0, print_buffer);
+	return cp != s && *cp == '\0' && !errno;
+}
+#endif
 
-	line_start = strlen(print_buffer) + 1;
+static bool sub_simple_opt_is_list(enum simple_opt_type type)
+{
+	return type == SIMPLE_OPT_INT_LIST || type == SIMPLE_OPT_UNSIGNED_LIST
+		|| type == SIMPLE_OPT_DOUBLE_LIST || type == SIMPLE_OPT_STRING_LIST;
+}
 
-	switch (result.result_type) {
-	case SIMPLE_OPT_RESULT_UNRECOGNISED_OPTION:
-		rval = snprintf(print_buffer, size, "unrecognised option `%s`",
-				result.option_string);
-		break;
+/* empty l, if o is a list, giving it to arena */
+static void sub_simple_opt_list_reset(const struct simple_opt *o,
+		struct simple_opt_list *l, struct simple_opt_arena *arena)
+{
+	if (!sub_simple_opt_is_list(o->type))
+		return;
 
-	case SIMPLE_OPT_RESULT_BAD_ARG:
-		rval = snprintf(print_buffer, size,
-				"bad argument `%s` passed to option `%s`",
-				result.argument_string, result.option_string);
+	if (l->arena == NULL)
+		free(l->items.p);
 
-		if (rval < 0 || (unsigned)rval >= size) {
-			fprintf(f, "simple-opt internal err: print buffer too small\n");
-			return;
-		}
+	l->items.p = NULL;
+	l->count = 0;
+	l->cap = 0;
+	l->arena = arena;
+}
 
-		sub_simple_opt_wrap_print(f, width, col, line_start,
-				print_buffer);
-		fprintf(f, "\n");
-		col = 0;
+/* parse s as an element of list option o, and append it to l */
+static enum simple_opt_result_type sub_simple_opt_parse_list(
+		const struct simple_opt *o, struct simple_opt_list *l, char *s,
+		struct simple_opt_arena *arena)
+{
+	union {
+		long v_int;
+		unsigned long v_unsigned;
+		double v_double;
+		char *v_string;
+	} v;
+	size_t size, cap;
+	bool ok;
+	void *p;
 
-		switch (result.option_type) {
-		case SIMPLE_OPT_BOOL:
+	switch (o->type) {
+	case SIMPLE_OPT_INT_LIST:
+		ok = sub_simple_opt_parse_long(s, &v.v_int);
+		size = sizeof(long);
+		break;
+	case SIMPLE_OPT_UNSIGNED_LIST:
+		ok = s[0] != '-' && s[0] != '+'
+			&& sub_simple_opt_parse_ulong(s, &v.v_unsigned);
+		size = sizeof(unsigned long);
+		break;
+	case SIMPLE_OPT_DOUBLE_LIST:
+		ok = sub_simple_opt_parse_double(s, &v.v_double);
+		size = sizeof(double);
+		break;
+	default:
+		v.v_string = s;
+		ok = true;
+		size = sizeof(char *);
+		break;
+	}
+
+	if (!ok)
+		return SIMPLE_OPT_RESULT_BAD_ARG;
+
+	/* a list can't be grown from anywhere but where it was allocated */
+	if (l->arena != arena)
+		sub_simple_opt_list_reset(o, l, arena);
+
+	if (l->count == l->cap) {
+		cap = l->cap > 0 ? l->cap * 2 : 8;
+		if (arena != NULL)
+			p = sub_simple_opt_arena_grow(arena, l->items.p, l->cap * size,
+					cap * size);
+		else
+			p = realloc(l->items.p, cap * size);
+		if (p == NULL)
+			return SIMPLE_OPT_RESULT_OUT_OF_MEMORY;
+
+		l->items.p = p;
+		l->cap = cap;
+	}
+
+	memcpy((char *)l->items.p + l->count * size, &v, size);
+	l->count++;
+
+	return SIMPLE_OPT_RESULT_SUCCESS;
+}
+
+/* fold the case of an ascii letter, whatever the locale */
+static unsigned char sub_simple_opt_fold(char c)
+{
+	return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : (unsigned char)c;
+}
+
+static bool sub_simple_opt_strcaseeq(const char *a, const char *b)
+{
+	for (; sub_simple_opt_fold(*a) == sub_simple_opt_fold(*b); a++, b++) {
+		if (*a == '\0')
+			return true;
+	}
+
+	return false;
+}
+
+/* parse s, of length len, as o's argument, into val */
+static bool sub_simple_opt_parse(const struct simple_opt *o,
+		union simple_opt_value_val *val, char *s, size_t len)
+{
+	unsigned i, j;
+	const char *str;
+	bool match;
+
+	switch (o->type) {
+	case SIMPLE_OPT_BOOL:
+		goto loop;
+strmatch:
+		for (j = 0; j < strlen(str); j++) {
+			if (s[j] == '\0' || tolower(s[j]) != str[j]) {
+				match = false;
+				goto strmatch_out;
+			}
+		}
+
+		match = true;
+		goto strmatch_out;
+loop:
+		for (i = 0; i < 6; i++) {
+			switch (i) {
+			case 0:
+				str = "true";
+				goto strmatch;
+			case 1:
+				str = "yes";
+				goto strmatch;
+			case 2:
+				str = "on";
+				goto strmatch;
+			case 3:
+				str = "false";
+				goto strmatch;
+			case 4:
+				str = "no";
+				goto strmatch;
+			case 5:
+				str = "off";
+				goto strmatch;
+			}
+strmatch_out:
+			if (match) {
+				if (i < 3)
+					val->v_bool = true;
+				else
+					val->v_bool = false;
+
+				return true;
+			}
+		}
+
+		return false;
+
+
+	case SIMPLE_OPT_INT:
+		return sub_simple_opt_parse_long(s, &val->v_int);
+
+	case SIMPLE_OPT_UNSIGNED:
+		if (s[0] == '-' || s[0] == '+')
+			return false;
+
+		return sub_simple_opt_parse_ulong(s, &val->v_unsigned);
+
+	case SIMPLE_OPT_DOUBLE:
+		return sub_simple_opt_parse_double(s, &val->v_double);
+
+	case SIMPLE_OPT_CHAR:
+		if (len == 2 && s[0] == '\\') {
+			switch (s[1]) {
+			case '0':
+				val->v_char = '\0';
+				break;
+			case 'a':
+				val->v_char = '\a';
+				break;
+			case 'b':
+				val->v_char = '\b';
+				break;
+			case 't':
+				val->v_char = '\t';
+				break;
+			case 'n':
+				val->v_char = '\n';
+				break;
+			case 'v':
+				val->v_char = '\v';
+				break;
+			case 'f':
+				val->v_char = '\f';
+				break;
+			case 'r':
+				val->v_char = '\r';
+				break;
+			case '\\':
+				val->v_char = '\\';
+				break;
+			default:
+				return false;
+			}
+			return true;
+		} else if (len != 1) {
+			return false;
+		}
+
+		val->v_char = s[0];
+		return true;
+
+	case SIMPLE_OPT_STRING:
+		val->v_string.str = s;
+		val->v_string.len = len;
+		return true;
+
+	case SIMPLE_OPT_STRING_SET:
+		for (i = 0; o->string_set[i] != NULL; i++) {
+			SUB_SIMPLE_OPT_STAT(string_compares);
+
+			if (o->string_set_nocase ?
+					sub_simple_opt_strcaseeq(s, o->string_set[i])
+					: !strcmp(s, o->string_set[i])) {
+				val->v_string_set_idx = i;
+				return true;
+			}
+		}
+
+		return false;
+
+	default:
+		return false;
+	}
+}
+
+/* the option t identifies, -1 if none does, or -2 if t is an abbreviation of
+ * more than one long name */
+static int sub_simple_opt_id(const struct sub_simple_opt_token *t,
+		struct simple_opt *o)
+{
+	int i, found = -1;
+	size_t len;
+	const char *s = t->s;
+
+	if (t->len < 2)
+		return -1;
+
+	/* a bundle of short options ("-abc") is identified by its first */
+	if (s[1] != '-') {
+		for (i = 0; o[i].type != SIMPLE_OPT_END; i++) {
+			if (s[1] == o[i].short_name)
+				return i;
+		}
+
+		return -1;
+	}
+
+	len = t->eq - 2;
+
+	for (i = 0; o[i].type != SIMPLE_OPT_END; i++) {
+		if (o[i].long_name == NULL)
+			continue;
+
+		SUB_SIMPLE_OPT_STAT(string_compares);
+
+		if ( strncmp(s + 2, o[i].long_name, len) )
+			continue;
+
+		/* a name in full beats any it's an abbreviation of */
+		if (o[i].long_name[len] == '\0')
+			return i;
+
+#ifndef SIMPLE_OPT_EXACT_LONG_NAMES
+		if (len > 0)
+			found = found == -1 ? i : -2;
+#endif
+	}
+
+	return found;
+}
+
+/* FNV-1a over the first len bytes of s */
+static uint32_t sub_simple_opt_hash(const char *s, size_t len)
+{
+	uint32_t h = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		h = (h ^ (unsigned char)s[i]) * 16777619u;
+
+	return h;
+}
+
+static int sub_simple_opt_cmp_long(const void *a, const void *b)
+{
+	return strcmp((*(const struct simple_opt * const *)a)->long_name,
+			(*(const struct simple_opt * const *)b)->long_name);
+}
+
+static bool sub_simple_opt_is_malformed(const struct simple_opt *o)
+{
+	return (o->short_name == '\0' && o->long_name == NULL)
+		|| (o->type == SIMPLE_OPT_FLAG && o->arg_is_required)
+		|| (o->type == SIMPLE_OPT_STRING_SET && o->string_set == NULL);
+}
+
+/* FNV-1a over s, as o matches it against its string set, storing its length
+ * in len */
+static uint32_t sub_simple_opt_set_hash(const struct simple_opt *o,
+		const char *s, size_t *len)
+{
+	uint32_t h = 2166136261u;
+	size_t i;
+
+	for (i = 0; s[i] != '\0'; i++) {
+		h = (h ^ (o->string_set_nocase ? sub_simple_opt_fold(s[i])
+					: (unsigned char)s[i])) * 16777619u;
+	}
+
+	*len = i;
+	return h;
+}
+
+/* build a table for each STRING_SET option in idx. where a string is
+ * duplicated the first wins, as it would when scanning the set */
+static bool sub_simple_opt_index_sets(struct simple_opt_index *idx)
+{
+	int i, k, n;
+	uint32_t size, h, j;
+	size_t len;
+	const struct simple_opt *o;
+	struct simple_opt_index_set *set;
+	struct simple_opt_index_slot *slot;
+
+	idx->sets = (struct simple_opt_index_set *)calloc(idx->count + 1,
+			sizeof(*idx->sets));
+	if (idx->sets == NULL)
+		return false;
+
+	for (i = 0; i < idx->count; i++) {
+		o = idx->options + i;
+		set = idx->sets + i;
+
+		if (o->type != SIMPLE_OPT_STRING_SET || o->string_set == NULL)
+			continue;
+
+		for (n = 0; o->string_set[n] != NULL; n++);
+
+		for (size = 8; size < 2 * (uint32_t)n; size *= 2);
+
+		set->mask = size - 1;
+		set->table = (struct simple_opt_index_slot *)malloc(
+				size * sizeof(*set->table));
+		if (set->table == NULL)
+			return false;
+
+		for (j = 0; j < size; j++)
+			set->table[j].opt = -1;
+
+		for (k = 0; k < n; k++) {
+			h = sub_simple_opt_set_hash(o, o->string_set[k], &len);
+
+			for (j = h & set->mask; ; j = (j + 1) & set->mask) {
+				slot = set->table + j;
+
+				if (slot->opt == -1) {
+					slot->hash = h;
+					slot->len = len;
+					slot->opt = k;
+					break;
+				}
+
+				if (slot->hash == h && slot->len == len
+						&& (o->string_set_nocase ?
+							sub_simple_opt_strcaseeq(
+								o->string_set[slot->opt],
+								o->string_set[k])
+							: !strcmp(o->string_set[slot->opt],
+								o->string_set[k])))
+					break;
+			}
+		}
+	}
+
+	return true;
+}
+
+/* match s against the string set of option opt_i through its table in idx,
+ * storing the match in val */
+static bool sub_simple_opt_index_set_id(const struct simple_opt_index *idx,
+		union simple_opt_value_val *val, int opt_i, const char *s)
+{
+	uint32_t h, j;
+	size_t len;
+	const struct simple_opt *o = idx->options + opt_i;
+	const struct simple_opt_index_set *set = idx->sets + opt_i;
+	const struct simple_opt_index_slot *slot;
+
+	h = sub_simple_opt_set_hash(o, s, &len);
+
+	for (j = h & set->mask; ; j = (j + 1) & set->mask) {
+		slot = set->table + j;
+
+		if (slot->opt == -1)
+			return false;
+
+		if (slot->hash != h || slot->len != len)
+			continue;
+
+		SUB_SIMPLE_OPT_STAT(string_compares);
+
+		if (o->string_set_nocase ?
+				sub_simple_opt_strcaseeq(o->string_set[slot->opt], s)
+				: !memcmp(o->string_set[slot->opt], s, len)) {
+			val->v_string_set_idx = slot->opt;
+			return true;
+		}
+	}
+}
+
+/* build idx over options, checking each option as it's added. where a name is
+ * duplicated the first option wins, as it would when scanning the array, and
+ * SIMPLE_OPT_RESULT_MALFORMED_OPTION_STRUCT is returned once the index is
+ * complete. the sorted long names and the string set tables are only built if
+ * full is set, as validating options and finding names in full need neither */
+static enum simple_opt_result_type sub_simple_opt_index_build(
+		struct simple_opt_index *idx, const struct simple_opt *options,
+		bool full)
+{
+	int i;
+	uint32_t size, h, j;
+	size_t len;
+	struct simple_opt_index_slot *slot;
+	enum simple_opt_result_type rt = SIMPLE_OPT_RESULT_SUCCESS;
+
+	idx->options = options;
+	idx->validated = false;
+	idx->long_sorted = NULL;
+	idx->sets = NULL;
+
+	for (i = 0; i < 256; i++)
+		idx->short_table[i] = -1;
+
+	for (i = 0; options[i].type != SIMPLE_OPT_END; i++);
+	idx->count = i;
+
+	/* keep the table at most half full */
+	for (size = 8; size < 2 * (uint32_t)idx->count; size *= 2);
+
+	idx->long_mask = size - 1;
+	idx->long_table = (struct simple_opt_index_slot *)malloc(
+			size * sizeof(*idx->long_table));
+	if (idx->long_table == NULL)
+		return SIMPLE_OPT_RESULT_OUT_OF_MEMORY;
+
+	for (j = 0; j < size; j++)
+		idx->long_table[j].opt = -1;
+
+	idx->long_count = 0;
+	if (full) {
+		idx->long_sorted = (const struct simple_opt **)malloc(
+				(idx->count + 1) * sizeof(*idx->long_sorted));
+		if (idx->long_sorted == NULL)
+			goto out_of_memory;
+	}
+
+	for (i = 0; i < idx->count; i++) {
+		if (sub_simple_opt_is_malformed(options + i))
+			rt = SIMPLE_OPT_RESULT_MALFORMED_OPTION_STRUCT;
+
+		if (options[i].short_name != '\0') {
+			if (idx->short_table[(unsigned char)options[i].short_name] == -1)
+				idx->short_table[(unsigned char)options[i].short_name] = i;
+			else
+				rt = SIMPLE_OPT_RESULT_MALFORMED_OPTION_STRUCT;
+		}
+
+		if (options[i].long_name == NULL)
+			continue;
+
+		if (full)
+			idx->long_sorted[idx->long_count++] = options + i;
+
+		len = strlen(options[i].long_name);
+		h = sub_simple_opt_hash(options[i].long_name, len);
+
+		for (j = h & idx->long_mask; ; j = (j + 1) & idx->long_mask) {
+			slot = idx->long_table + j;
+
+			if (slot->opt == -1) {
+				slot->hash = h;
+				slot->len = len;
+				slot->opt = i;
+				break;
+			}
+
+			if (slot->hash == h && slot->len == len
+					&& !memcmp(options[slot->opt].long_name,
+						options[i].long_name, len)) {
+				rt = SIMPLE_OPT_RESULT_MALFORMED_OPTION_STRUCT;
+				break;
+			}
+		}
+	}
+
+	if (full) {
+		qsort(idx->long_sorted, idx->long_count, sizeof(*idx->long_sorted),
+				sub_simple_opt_cmp_long);
+
+		if (!sub_simple_opt_index_sets(idx))
+			goto out_of_memory;
+	}
+
+	idx->validated = (rt == SIMPLE_OPT_RESULT_SUCCESS);
+
+	return rt;
+
+out_of_memory:
+	simple_opt_index_free(idx);
+	return SIMPLE_OPT_RESULT_OUT_OF_MEMORY;
+}
+
+static bool simple_opt_index_init(struct simple_opt_index *idx,
+		const struct simple_opt *options)
+{
+	return sub_simple_opt_index_build(idx, options, true)
+		!= SIMPLE_OPT_RESULT_OUT_OF_MEMORY;
+}
+
+static void simple_opt_index_free(struct simple_opt_index *idx)
+{
+	int i;
+
+	free(idx->long_table);
+	idx->long_table = NULL;
+	free(idx->long_sorted);
+	idx->long_sorted = NULL;
+
+	if (idx->sets == NULL)
+		return;
+
+	for (i = 0; i < idx->count; i++)
+		free(idx->sets[i].table);
+
+	free(idx->sets);
+	idx->sets = NULL;
+}
+
+static enum simple_opt_result_type simple_opt_compile(
+		struct simple_opt_index *idx, const struct simple_opt *options)
+{
+	enum simple_opt_result_type rt;
+
+	rt = sub_simple_opt_index_build(idx, options, true);
+
+	if (rt == SIMPLE_OPT_RESULT_MALFORMED_OPTION_STRUCT)
+		simple_opt_index_free(idx);
+
+	return rt;
+}
+
+/* the fallback for when there's no memory for a hash table. can't modify
+ * anything so this is going to be pretty not-optimised, but ah well */
+static enum simple_opt_result_type sub_simple_opt_validate_slow(
+		const struct simple_opt *options)
+{
+	int i, j;
+
+	for (i = 0; options[i].type != SIMPLE_OPT_END; i++) {
+		if (sub_simple_opt_is_malformed(options + i))
+			return SIMPLE_OPT_RESULT_MALFORMED_OPTION_STRUCT;
+	}
+
+	for (i = 0; options[i].type != SIMPLE_OPT_END; i++) {
+		for (j = i + 1; options[j].type != SIMPLE_OPT_END; j++) {
+			if ( ( options[i].short_name != '\0'
+						&& options[i].short_name == options[j].short_name)
+					|| ( options[i].long_name != NULL
+						&& options[j].long_name != NULL
+						&& !strcmp(options[i].long_name, options[j].long_name))
+				)
+				return SIMPLE_OPT_RESULT_MALFORMED_OPTION_STRUCT;
+		}
+	}
+
+	return SIMPLE_OPT_RESULT_SUCCESS;
+}
+
+static enum simple_opt_result_type simple_opt_validate(
+		const struct simple_opt *options)
+{
+	struct simple_opt_index idx;
+	enum simple_opt_result_type rt;
+
+	rt = sub_simple_opt_index_build(&idx, options, false);
+
+	if (rt == SIMPLE_OPT_RESULT_OUT_OF_MEMORY)
+		return sub_simple_opt_validate_slow(options);
+
+	simple_opt_index_free(&idx);
+
+	return rt;
+}
+
+#ifndef SIMPLE_OPT_EXACT_LONG_NAMES
+/* the option whose long name starts with the len chars at s, -1 if none, or
+ * -2 if more than one does. names sharing a prefix are adjacent once sorted, so
+ * it's a binary search for the first of them and a look at the one after */
+static int sub_simple_opt_index_prefix(const char *s, size_t len,
+		const struct simple_opt_index *idx)
+{
+	int lo = 0, hi = idx->long_count, mid;
+
+	if (len == 0)
+		return -1;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+
+		SUB_SIMPLE_OPT_STAT(string_compares);
+
+		if (strncmp(idx->long_sorted[mid]->long_name, s, len) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == idx->long_count
+			|| strncmp(idx->long_sorted[lo]->long_name, s, len))
+		return -1;
+
+	if (lo + 1 < idx->long_count
+			&& !strncmp(idx->long_sorted[lo + 1]->long_name, s, len))
+		return -2;
+
+	return idx->long_sorted[lo] - idx->options;
+}
+#endif
+
+/* the option with the long name of the len chars at s in idx, or -1 */
+static int sub_simple_opt_index_long(const char *s, size_t len,
+		const struct simple_opt_index *idx)
+{
+	uint32_t h, j;
+	const struct simple_opt_index_slot *slot;
+
+	h = sub_simple_opt_hash(s, len);
+
+	for (j = h & idx->long_mask; ; j = (j + 1) & idx->long_mask) {
+		slot = idx->long_table + j;
+
+		if (slot->opt == -1)
+			return -1;
+
+		if (slot->hash != h || slot->len != len)
+			continue;
+
+		SUB_SIMPLE_OPT_STAT(string_compares);
+
+		if (!memcmp(idx->options[slot->opt].long_name, s, len))
+			return slot->opt;
+	}
+}
+
+/* as sub_simple_opt_id, but a table lookup into idx */
+static int sub_simple_opt_index_id(const struct sub_simple_opt_token *t,
+		const struct simple_opt_index *idx)
+{
+	int opt_i;
+	size_t len;
+	const char *s = t->s;
+
+	if (t->len < 2)
+		return -1;
+
+	if (s[1] != '-')
+		return idx->short_table[(unsigned char)s[1]];
+
+	/* the name stops at any "=arg" */
+	len = t->eq - 2;
+	opt_i = sub_simple_opt_index_long(s + 2, len, idx);
+
+	/* not a name in full, so perhaps an abbreviation of one */
+#ifndef SIMPLE_OPT_EXACT_LONG_NAMES
+	if (opt_i == -1)
+		opt_i = sub_simple_opt_index_prefix(s + 2, len, idx);
+#endif
+
+	return opt_i;
+}
+
+static int sub_simple_opt_lookup(const struct sub_simple_opt_token *t,
+		struct simple_opt *o, const struct simple_opt_index *idx)
+{
+	SUB_SIMPLE_OPT_STAT(lookups);
+
+	if (idx != NULL)
+		return sub_simple_opt_index_id(t, idx);
+
+	return sub_simple_opt_id(t, o);
+}
+
+/* load the file at path into a buffer with one writable byte spare past its
+ * end, for a terminating NUL. where possible it's mapped rather than read, so
+ * that only the parts of it which have been tokenised are ever copied */
+static struct simple_opt_response_file *sub_simple_opt_rfile_load(
+		const char *path, struct simple_opt_arena *arena)
+{
+	struct simple_opt_response_file *rf;
+#ifdef SUB_SIMPLE_OPT_MMAP
+	int fd;
+	struct stat st;
+	void *p;
+#endif
+	FILE *fp;
+	long size;
+
+	if (arena != NULL)
+		rf = (struct simple_opt_response_file *)simple_opt_arena_alloc(arena,
+				sizeof(*rf));
+	else
+		rf = (struct simple_opt_response_file *)malloc(sizeof(*rf));
+	if (rf == NULL)
+		return NULL;
+
+	/* a file loaded into an arena is read into it, as a mapping would have
+	 * to be unmapped when the arena is reset */
+#ifdef SUB_SIMPLE_OPT_MMAP
+	if (arena != NULL)
+		goto read;
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1)
+		goto err;
+
+	if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+		close(fd);
+		goto err;
+	}
+
+	/* reserve a zeroed region one byte larger than the file, then map the
+	 * file privately over the start of it */
+	rf->size = st.st_size;
+	rf->is_mapped = true;
+	p = mmap(NULL, rf->size + 1, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED) {
+		close(fd);
+		goto err;
+	}
+
+	if (rf->size > 0 && mmap(p, rf->size, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+		munmap(p, rf->size + 1);
+		close(fd);
+		goto err;
+	}
+
+	close(fd);
+#ifdef MADV_SEQUENTIAL
+	madvise(p, rf->size + 1, MADV_SEQUENTIAL);
+#endif
+	rf->buf = (char *)p;
+
+	return rf;
+
+read:
+#endif
+	fp = fopen(path, "rb");
+	if (fp == NULL)
+		goto err;
+
+	if (fseek(fp, 0, SEEK_END) || (size = ftell(fp)) < 0
+			|| fseek(fp, 0, SEEK_SET)) {
+		fclose(fp);
+		goto err;
+	}
+
+	rf->size = size;
+	rf->is_mapped = false;
+	if (arena != NULL)
+		rf->buf = (char *)simple_opt_arena_alloc(arena, rf->size + 1);
+	else
+		rf->buf = (char *)malloc(rf->size + 1);
+
+	if (rf->buf == NULL || fread(rf->buf, 1, rf->size, fp) != rf->size) {
+		if (arena == NULL)
+			free(rf->buf);
+		fclose(fp);
+		goto err;
+	}
+
+	fclose(fp);
+
+	return rf;
+
+err:
+	/* anything taken from an arena is left there until it's reset */
+	if (arena == NULL)
+		free(rf);
+	return NULL;
+}
+
+#ifdef SIMPLE_OPT_RESPONSE_FILES
+/* read the next argument from the response file between *pos and end,
+ * handling quoting the way a shell would. unquoting is done in place, and the
+ * argument NUL-terminated where it ends. NULL is returned at the end of the
+ * file, or if a quote is never closed, which sets unterminated */
+static char *sub_simple_opt_rfile_token(char **pos, char *end,
+		bool *unterminated)
+{
+	char *r = *pos, *w, *tok;
+	char quote = '\0';
+
+	while (r < end && isspace((unsigned char)*r))
+		r++;
+
+	if (r == end) {
+		*pos = r;
+		return NULL;
+	}
+
+	tok = w = r;
+	while (r < end) {
+		if (quote == '\'') {
+			if (*r == '\'') {
+				quote = '\0';
+				r++;
+				continue;
+			}
+		} else if (*r == '\\' && r + 1 < end
+				&& (quote == '\0' || r[1] == '"' || r[1] == '\\')) {
+			r++;
+		} else if (quote == '"' && *r == '"') {
+			quote = '\0';
+			r++;
+			continue;
+		} else if (quote == '\0') {
+			if (isspace((unsigned char)*r))
+				break;
+
+			if (*r == '\'' || *r == '"') {
+				quote = *r++;
+				continue;
+			}
+		}
+
+		*w++ = *r++;
+	}
+
+	if (quote != '\0') {
+		*unterminated = true;
+		return NULL;
+	}
+
+	/* skip past the delimiter, which the terminator may overwrite */
+	if (r < end)
+		r++;
+
+	*w = '\0';
+	*pos = r;
+
+	return tok;
+}
+
+static bool sub_simple_opt_rfile_open(struct sub_simple_opt_stream *st,
+		char *arg)
+{
+	struct simple_opt_response_file *rf;
+
+	st->error_string = arg;
+
+	if (st->depth >= SIMPLE_OPT_RESPONSE_FILE_DEPTH) {
+		st->error = SIMPLE_OPT_RESULT_BAD_RESPONSE_FILE;
+		st->error_detail = "is nested too deeply";
+		return false;
+	}
+
+	rf = sub_simple_opt_rfile_load(arg + 1, st->arena);
+	if (rf == NULL) {
+		st->error = SIMPLE_OPT_RESULT_BAD_RESPONSE_FILE;
+		return false;
+	}
+
+	if (st->arena == NULL) {
+		rf->next = *st->files;
+		*st->files = rf;
+	}
+
+	st->file_pos[st->depth] = rf->buf;
+	st->file_end[st->depth] = rf->buf + rf->size;
+	st->file_arg[st->depth] = arg;
+	st->depth++;
+
+	return true;
+}
+#endif
+
+#ifdef SUB_SIMPLE_OPT_SSE2
+/* the length of s, storing the offset of its first "=" (or its length, if it
+ * has none) in eq. s is read in aligned blocks of 16 bytes, each checked for
+ * both characters at once */
+SUB_SIMPLE_OPT_NO_ASAN
+static size_t sub_simple_opt_scan(const char *s, size_t *eq)
+{
+	const __m128i *p = (const __m128i *)((uintptr_t)s & ~(uintptr_t)15);
+	unsigned shift = (uintptr_t)s & 15;
+	unsigned zeros, equals;
+	size_t off = 0;
+	bool found_eq = false;
+	__m128i v;
+
+	while (1) {
+		v = _mm_load_si128(p++);
+
+		/* the bytes of the first block before s aren't part of it */
+		zeros = (unsigned)_mm_movemask_epi8(
+				_mm_cmpeq_epi8(v, _mm_setzero_si128())) >> shift;
+		equals = (unsigned)_mm_movemask_epi8(
+				_mm_cmpeq_epi8(v, _mm_set1_epi8('='))) >> shift;
+
+		if (zeros != 0)
+			equals &= zeros ^ (zeros - 1);
+
+		if (!found_eq && equals != 0) {
+			*eq = off + __builtin_ctz(equals);
+			found_eq = true;
+		}
+
+		if (zeros != 0) {
+			off += __builtin_ctz(zeros);
+			if (!found_eq)
+				*eq = off;
+			return off;
+		}
+
+		off += 16 - shift;
+		shift = 0;
+	}
+}
+#else
+static size_t sub_simple_opt_scan(const char *s, size_t *eq)
+{
+	size_t i;
+	const char *e = NULL;
+
+	for (i = 0; s[i] != '\0'; i++) {
+		if (s[i] == '=' && e == NULL)
+			e = s + i;
+	}
+
+	*eq = e != NULL ? (size_t)(e - s) : i;
+	return i;
+}
+#endif
+
+/* read the next argument into t, returning it, or NULL if there are none.
+ * every argument is scanned here, once, for what parsing needs to know of
+ * its length and form */
+static char *sub_simple_opt_stream_next(struct sub_simple_opt_stream *st,
+		struct sub_simple_opt_token *t)
+{
+	char *s;
+#ifdef SIMPLE_OPT_RESPONSE_FILES
+	bool unterminated = false;
+#endif
+
+	if (st->peeked.s != NULL) {
+		*t = st->peeked;
+		st->peeked.s = NULL;
+		return t->s;
+	}
+
+	while (st->error == SIMPLE_OPT_RESULT_SUCCESS) {
+#ifdef SIMPLE_OPT_RESPONSE_FILES
+		if (st->depth > 0) {
+			s = sub_simple_opt_rfile_token(st->file_pos + st->depth - 1,
+					st->file_end[st->depth - 1], &unterminated);
+			if (unterminated) {
+				st->error = SIMPLE_OPT_RESULT_BAD_RESPONSE_FILE;
+				st->error_string = st->file_arg[st->depth - 1];
+				st->error_detail = "has an unterminated quote";
+				continue;
+			}
+
+			if (s == NULL) {
+				st->depth--;
+				continue;
+			}
+		} else
+#endif
+		if (st->i < st->argc) {
+			s = st->argv[st->i++];
+		} else {
+			return NULL;
+		}
+
+#ifdef SIMPLE_OPT_RESPONSE_FILES
+		if (st->expand && s[0] == '@' && s[1] != '\0') {
+			sub_simple_opt_rfile_open(st, s);
+			continue;
+		}
+#endif
+
+		t->s = s;
+		t->len = sub_simple_opt_scan(s, &t->eq);
+		return s;
+	}
+
+	t->s = NULL;
+	return NULL;
+}
+
+static const struct sub_simple_opt_token *sub_simple_opt_stream_peek(
+		struct sub_simple_opt_stream *st)
+{
+	if (st->peeked.s == NULL)
+		sub_simple_opt_stream_next(st, &st->peeked);
+
+	return st->peeked.s != NULL ? &st->peeked : NULL;
+}
+
+/* the option with short name c, through a table so that each option in a
+ * bundle is found in constant time */
+static int sub_simple_opt_short_id(struct simple_opt_iter *it, char c)
+{
+	int i;
+
+	if (it->idx != NULL)
+		return it->idx->short_table[(unsigned char)c];
+
+	if (!it->short_table_built) {
+		for (i = 0; i < 256; i++)
+			it->short_table[i] = -1;
+
+		/* where a name is duplicated the first option wins, as it does when
+		 * scanning the array */
+		for (i = 0; it->options[i].type != SIMPLE_OPT_END; i++) {
+			if (it->options[i].short_name != '\0' && it->short_table[
+					(unsigned char)it->options[i].short_name] == -1)
+				it->short_table[(unsigned char)it->options[i].short_name] = i;
+		}
+
+		it->short_table_built = true;
+	}
+
+	return it->short_table[(unsigned char)c];
+}
+
+/* where an option's parsed state is kept: in the option itself, or in a
+ * struct simple_opt_value apart from it. exactly one of val and value_val is
+ * set, and list and count point into it */
+struct sub_simple_opt_state {
+	bool *was_seen;
+	bool *arg_is_stored;
+	enum simple_opt_source *source;
+	union simple_opt_val *val;
+	union simple_opt_value_val *value_val;
+	struct simple_opt_list *list;
+	unsigned long *count;
+};
+
+static struct sub_simple_opt_state sub_simple_opt_own_state(
+		struct simple_opt *o)
+{
+	struct sub_simple_opt_state v;
+
+	v.was_seen = &o->was_seen;
+	v.arg_is_stored = &o->arg_is_stored;
+	v.source = &o->source;
+	v.val = &o->val;
+	v.value_val = NULL;
+	v.list = &o->val.v_list;
+	v.count = &o->val.v_count;
+	return v;
+}
+
+/* the state of option i, in values if they're kept apart from options */
+static struct sub_simple_opt_state sub_simple_opt_state(
+		struct simple_opt *options, struct simple_opt_value *values, int i)
+{
+	struct sub_simple_opt_state v;
+
+	if (values == NULL)
+		return sub_simple_opt_own_state(options + i);
+
+	v.was_seen = &values[i].was_seen;
+	v.arg_is_stored = &values[i].arg_is_stored;
+	v.source = &values[i].source;
+	v.val = NULL;
+	v.value_val = &values[i].val;
+	v.list = &values[i].val.v_list;
+	v.count = &values[i].val.v_count;
+	return v;
+}
+
+/* discard o's value, as if it had never been seen */
+static void sub_simple_opt_unset(const struct simple_opt *o,
+		const struct sub_simple_opt_state *v)
+{
+	if (*v->was_seen)
+		sub_simple_opt_list_reset(o, v->list, v->list->arena);
+
+	*v->was_seen = false;
+	*v->arg_is_stored = false;
+	*v->source = SIMPLE_OPT_SOURCE_DEFAULT;
+}
+
+/* mark o as seen in source, counting how many times a flag has been. returns
+ * false if o's value came from a source of higher precedence, which it's left
+ * with. a value from a source of lower precedence is discarded rather than
+ * added to */
+static bool sub_simple_opt_seen(const struct simple_opt *o,
+		const struct sub_simple_opt_state *v, enum simple_opt_source source)
+{
+	if (*v->source > source)
+		return false;
+
+	if (*v->source < source) {
+		sub_simple_opt_unset(o, v);
+		*v->source = source;
+	}
+
+	if (o->type == SIMPLE_OPT_FLAG)
+		*v->count = *v->was_seen ? *v->count + 1 : 1;
+
+	*v->was_seen = true;
+	return true;
+}
+
+/* store parsed, o's value, in val, copying a string unless
+ * SIMPLE_OPT_STRING_REF is defined */
+static void sub_simple_opt_store(const struct simple_opt *o,
+		union simple_opt_val *val, const union simple_opt_value_val *parsed)
+{
+	switch (o->type) {
+	case SIMPLE_OPT_BOOL:
+		val->v_bool = parsed->v_bool;
+		break;
+	case SIMPLE_OPT_INT:
+		val->v_int = parsed->v_int;
+		break;
+	case SIMPLE_OPT_UNSIGNED:
+		val->v_unsigned = parsed->v_unsigned;
+		break;
+	case SIMPLE_OPT_DOUBLE:
+		val->v_double = parsed->v_double;
+		break;
+	case SIMPLE_OPT_CHAR:
+		val->v_char = parsed->v_char;
+		break;
+	case SIMPLE_OPT_STRING:
+#ifdef SIMPLE_OPT_STRING_REF
+		val->v_string = parsed->v_string;
+#else
+		memcpy(val->v_string, parsed->v_string.str, parsed->v_string.len);
+		val->v_string[parsed->v_string.len] = '\0';
+#endif
+		break;
+	case SIMPLE_OPT_STRING_SET:
+		val->v_string_set_idx = parsed->v_string_set_idx;
+		break;
+	default:
+		break;
+	}
+}
+
+/* parse s, of length len, as the argument of o, option opt_i, into v,
+ * wherever it came from. with idx, a string set is matched through its
+ * table */
+static enum simple_opt_result_type sub_simple_opt_convert(
+		const struct simple_opt *o, const struct sub_simple_opt_state *v,
+		int opt_i, char *s, size_t len, const struct simple_opt_index *idx,
+		struct simple_opt_arena *arena)
+{
+	union simple_opt_value_val parsed;
+	union simple_opt_value_val *val;
+
+#ifndef SIMPLE_OPT_STRING_REF
+	/* is there space for the arg (if this opt wants a string copied)? */
+	if (v->val != NULL && o->type == SIMPLE_OPT_STRING
+			&& len + 1 >= SIMPLE_OPT_OPT_ARG_MAX_WIDTH)
+		return SIMPLE_OPT_RESULT_OPT_ARG_TOO_LONG;
+#endif
+
+	SUB_SIMPLE_OPT_STAT(conversions[o->type]);
+
+	if (sub_simple_opt_is_list(o->type))
+		return sub_simple_opt_parse_list(o, v->list, s, arena);
+
+	/* a value is parsed into directly, and an option's own value through a
+	 * copy, so that its string may be */
+	val = v->value_val != NULL ? v->value_val : &parsed;
+
+	if (!(o->type == SIMPLE_OPT_STRING_SET && idx != NULL
+			? sub_simple_opt_index_set_id(idx, val, opt_i, s)
+			: sub_simple_opt_parse(o, val, s, len)))
+		return SIMPLE_OPT_RESULT_BAD_ARG;
+
+	if (v->val != NULL)
+		sub_simple_opt_store(o, v->val, val);
+
+	return SIMPLE_OPT_RESULT_SUCCESS;
+}
+
+static void sub_simple_opt_iter_init(struct simple_opt_iter *it, int argc,
+		char **argv, struct simple_opt *options,
+		struct simple_opt_value *values, const struct simple_opt_index *idx,
+		struct simple_opt_result_into *r)
+{
+#ifdef SIMPLE_OPT_STATS
+	uint64_t start = sub_simple_opt_stats_ns();
+#endif
+
+	it->options = options;
+	it->values = values;
+	it->idx = idx;
+	it->option = NULL;
+	it->arg = NULL;
+	it->r = r;
+	r->source = SIMPLE_OPT_SOURCE_CLI;
+	it->after_marker = false;
+	it->started = false;
+	it->bundle = NULL;
+	it->short_table_built = false;
+
+	it->st.argc = argc;
+	it->st.argv = argv;
+	it->st.i = 1;
+	it->st.peeked.s = NULL;
+	it->st.expand = true;
+	it->st.error = SIMPLE_OPT_RESULT_SUCCESS;
+	it->st.error_string = NULL;
+	it->st.error_detail = NULL;
+	it->st.depth = 0;
+	it->st.files = &r->response_files;
+	it->st.arena = NULL;
+
+	/* an index which was validated when it was built needn't be checked
+	 * again */
+	if (idx == NULL || !idx->validated)
+		r->result_type = simple_opt_validate(options);
+	else
+		r->result_type = SIMPLE_OPT_RESULT_SUCCESS;
+
+#ifdef SIMPLE_OPT_STATS
+	SUB_SIMPLE_OPT_STAT_ADD(validate_ns, sub_simple_opt_stats_ns() - start);
+#endif
+
+	it->event = r->result_type == SIMPLE_OPT_RESULT_SUCCESS ?
+		SIMPLE_OPT_EVENT_OPTION : SIMPLE_OPT_EVENT_ERROR;
+}
+
+static void simple_opt_iter_init(struct simple_opt_iter *it, int argc,
+		char **argv, struct simple_opt *options, struct simple_opt_index *idx)
+{
+	it->result.argc = 0;
+	it->result.argv = NULL;
+	it->result.argv_cap = 0;
+	it->result.option_string = NULL;
+	it->result.argument_string = NULL;
+	it->result.response_files = NULL;
+	it->result.arena = NULL;
+
+	/* the iterator writes into the options the index was built over */
+	sub_simple_opt_iter_init(it, argc, argv,
+			idx != NULL ? (struct simple_opt *)idx->options : options, NULL,
+			idx, &it->result);
+}
+
+static enum simple_opt_event simple_opt_next(struct simple_opt_iter *it)
+{
+	int opt_i;
+	char c;
+	char *s, *arg, *opt_end = NULL;
+	size_t s_len;
+	bool separate;
+	enum simple_opt_result_type rt;
+	struct sub_simple_opt_token tok;
+	const struct sub_simple_opt_token *next;
+	struct sub_simple_opt_state v;
+	struct simple_opt *options = it->options;
+	struct simple_opt_result_into *r = it->r;
+
+	if (it->event == SIMPLE_OPT_EVENT_END
+			|| it->event == SIMPLE_OPT_EVENT_ERROR)
+		return it->event;
+
+	/* lists in an arena may have been reset with it since they were last
+	 * parsed into, so each parse starts its own afresh */
+	if (!it->started) {
+		it->started = true;
+		it->st.arena = r->arena;
+		for (opt_i = 0; r->arena != NULL
+				&& options[opt_i].type != SIMPLE_OPT_END; opt_i++) {
+			v = sub_simple_opt_state(options, it->values, opt_i);
+			if (*v.source == SIMPLE_OPT_SOURCE_CLI)
+				sub_simple_opt_list_reset(options + opt_i, v.list, r->arena);
+		}
+	}
+
+	it->option = NULL;
+	it->arg = NULL;
+
+	if (it->bundle != NULL)
+		goto bundle;
+
+	while (1) {
+		arg = sub_simple_opt_stream_next(&it->st, &tok);
+
+		if (arg == NULL)
+			goto stream_end;
+
+		/* everything after "--" is a non-option */
+		if (it->after_marker)
+			goto non_option;
+
+		/* "following are non-opts" marker */
+		if (tok.len == 2 && arg[0] == '-' && arg[1] == '-') {
+			it->after_marker = true;
+			it->st.expand = false;
+			continue;
+		}
+
+		break;
+	}
+
+	/* if not an opt, it's a non-option argument */
+	if (arg[0] != '-')
+		goto non_option;
+
+	/* unrecognised argument */
+	if (tok.len < 2) {
+		r->result_type = SIMPLE_OPT_RESULT_UNRECOGNISED_OPTION;
+		goto opt_copy_and_return;
+	}
+
+	/* a bundle of short options, each of which is returned in turn */
+	if (arg[1] != '-' && tok.len > 2) {
+		it->bundle = arg + 1;
+		it->bundle_arg = tok;
+		goto bundle;
+	}
+
+	/* identify this option */
+	opt_i = sub_simple_opt_lookup(&tok, options, it->idx);
+
+	if (opt_i == -1) {
+		r->result_type = SIMPLE_OPT_RESULT_UNRECOGNISED_OPTION;
+		goto opt_copy_and_return;
+	}
+
+	if (opt_i == -2) {
+		r->result_type = SIMPLE_OPT_RESULT_AMBIGUOUS_OPTION;
+		goto opt_copy_and_return;
+	}
+
+	v = sub_simple_opt_state(options, it->values, opt_i);
+	sub_simple_opt_seen(options + opt_i, &v, SIMPLE_OPT_SOURCE_CLI);
+	it->option = options + opt_i;
+
+	if (options[opt_i].type == SIMPLE_OPT_FLAG)
+		return it->event = SIMPLE_OPT_EVENT_OPTION;
+
+	/* if there's an arg, is it a separate element in argv? or is it passed
+	 * as "--X=arg"? the name may have been abbreviated, so it's the "=" that
+	 * ends it */
+	c = arg[1] == '-' ? arg[tok.eq] : '\0';
+
+arg_follows:
+	/* if this option doesn't require an arg and none is to be found,
+	 * just return it */
+	if (!options[opt_i].arg_is_required && c == '\0') {
+		SUB_SIMPLE_OPT_STAT(lookaheads);
+		next = sub_simple_opt_stream_peek(&it->st);
+
+		/* only an argument starting with '-' can be an option, as the
+		 * lookup reads a short name from any second character */
+		if (next == NULL || (next->len == 2 && next->s[0] == '-'
+					&& next->s[1] == '-')
+				|| (next->s[0] == '-'
+					&& sub_simple_opt_lookup(next, options, it->idx) != -1))
+			return it->event = SIMPLE_OPT_EVENT_OPTION;
+	}
+
+	if (c == '\0') {
+		next = sub_simple_opt_stream_peek(&it->st);
+		if (next == NULL) {
+			if (it->st.error != SIMPLE_OPT_RESULT_SUCCESS)
+				goto stream_end;
+
+			r->result_type = SIMPLE_OPT_RESULT_MISSING_ARG;
+			r->option_type = options[opt_i].type;
+			r->option = options + opt_i;
+			goto opt_copy_and_return;
+		}
+		s = next->s;
+		s_len = next->len;
+		separate = true;
+	} else {
+		if (tok.eq + 1 == tok.len) {
+			r->result_type = SIMPLE_OPT_RESULT_MISSING_ARG;
+			r->option_type = options[opt_i].type;
+			r->option = options + opt_i;
+			goto opt_copy_and_return;
+		}
+
+		s = arg + tok.eq + 1;
+		s_len = tok.len - tok.eq - 1;
+		separate = false;
+	}
+
+parse_arg:
+	/* try to actually parse the thing */
+	rt = sub_simple_opt_convert(options + opt_i, &v, opt_i, s, s_len,
+			it->idx, r->arena);
+
+	if (rt == SIMPLE_OPT_RESULT_OPT_ARG_TOO_LONG) {
+		r->result_type = rt;
+		r->option_type = options[opt_i].type;
+		r->option = options + opt_i;
+		goto opt_copy_and_return;
+	}
+
+	if (rt == SIMPLE_OPT_RESULT_SUCCESS) {
+		*v.arg_is_stored = true;
+		it->arg = s;
+		/* skip forwards if this wasn't an "="-type argument passing */
+		if (separate)
+			sub_simple_opt_stream_next(&it->st, &tok);
+	} else {
+		SUB_SIMPLE_OPT_STAT(conversion_failures);
+		r->result_type = rt;
+		r->option_type = options[opt_i].type;
+		r->argument_string = s;
+		r->option = options + opt_i;
+		goto opt_copy_and_return;
+	}
+
+	return it->event = SIMPLE_OPT_EVENT_OPTION;
+
+non_option:
+	it->arg = arg;
+	return it->event = SIMPLE_OPT_EVENT_ARG;
+
+bundle:
+	/* errors in a bundle are reported against the part of it up to the
+	 * option at fault */
+	tok = it->bundle_arg;
+	arg = tok.s;
+	opt_end = it->bundle + 1;
+	opt_i = sub_simple_opt_short_id(it, *it->bundle);
+	it->bundle = opt_end < arg + tok.len ? opt_end : NULL;
+
+	if (opt_i == -1) {
+		it->bundle = NULL;
+		r->result_type = SIMPLE_OPT_RESULT_UNRECOGNISED_OPTION;
+		goto opt_copy_and_return;
+	}
+
+	v = sub_simple_opt_state(options, it->values, opt_i);
+	sub_simple_opt_seen(options + opt_i, &v, SIMPLE_OPT_SOURCE_CLI);
+	it->option = options + opt_i;
+
+	if (options[opt_i].type == SIMPLE_OPT_FLAG)
+		return it->event = SIMPLE_OPT_EVENT_OPTION;
+
+	/* an option taking an argument takes the rest of the bundle ("-ofile"),
+	 * or if there's none, the next argument */
+	if (it->bundle == NULL) {
+		c = '\0';
+		goto arg_follows;
+	}
+
+	s = it->bundle;
+	s_len = tok.len - (s - arg);
+	it->bundle = NULL;
+	separate = false;
+	goto parse_arg;
+
+stream_end:
+	if (it->st.error != SIMPLE_OPT_RESULT_SUCCESS) {
+		r->result_type = it->st.error;
+		r->option_string = it->st.error_string;
+		r->option_string_len = strlen(it->st.error_string);
+		r->argument_string = it->st.error_detail;
+		return it->event = SIMPLE_OPT_EVENT_ERROR;
+	}
+
+	return it->event = SIMPLE_OPT_EVENT_END;
+
+opt_copy_and_return:
+	/* an option is reported up to any "=arg", or in a bundle, up to the
+	 * option at fault */
+	r->option_string = arg;
+	r->option_string_len = opt_end != NULL ? (size_t)(opt_end - arg)
+		: tok.eq;
+
+	return it->event = SIMPLE_OPT_EVENT_ERROR;
+}
+
+/* compile command's options, if that hasn't been done already */
+static bool sub_simple_opt_command_compile(struct simple_opt_command *command,
+		struct simple_opt_result_into *r)
+{
+	if (command->is_compiled)
+		return true;
+
+	r->result_type = simple_opt_compile(&command->idx, command->options);
+	command->is_compiled = (r->result_type == SIMPLE_OPT_RESULT_SUCCESS);
+
+	return command->is_compiled;
+}
+
+/* switch it over to parsing the options of the subcommand of *command which
+ * it->arg names */
+static bool sub_simple_opt_command_enter(struct simple_opt_iter *it,
+		struct simple_opt_command **command, struct simple_opt_result_into *r)
+{
+	struct simple_opt_command *sub;
+
+	for (sub = (*command)->subcommands; sub->name != NULL; sub++) {
+		if (!strcmp(sub->name, it->arg))
+			break;
+	}
+
+	if (sub->name == NULL) {
+		r->result_type = SIMPLE_OPT_RESULT_UNRECOGNISED_COMMAND;
+		r->option_string = it->arg;
+		r->option_string_len = strlen(it->arg);
+		return false;
+	}
+
+	if (!sub_simple_opt_command_compile(sub, r))
+		return false;
+
+	sub->was_seen = true;
+	*command = sub;
+
+	it->options = sub->options;
+	it->idx = &sub->idx;
+	it->short_table_built = false;
+
+	/* so that the new options' lists are started afresh, as the first
+	 * options' were */
+	it->started = false;
+
+	return true;
+}
+
+/* parse into options, or values if they're kept apart. with command, the
+ * first non-option argument below a command with subcommands names one of
+ * them, and *command is left as the last named */
+static enum simple_opt_result_type sub_simple_opt_parse_core(int argc,
+		char **argv, struct simple_opt *options,
+		struct simple_opt_value *values, const struct simple_opt_index *idx,
+		struct simple_opt_command **command, struct simple_opt_result_into *r)
+{
+	bool in_place = false;
+	char **out = r->argv;
+	int out_cap = r->argv_cap;
+	struct simple_opt_iter it;
+#ifdef SIMPLE_OPT_STATS
+	uint64_t start;
+#endif
+
+	r->argc = 0;
+	SUB_SIMPLE_OPT_STAT(parses);
+
+	/* with no storage provided, non-options are moved down argv itself. that
+	 * can only ever fill elements which have already been read, unless
+	 * response files add more arguments than argv held. r is left as it is,
+	 * so that a result reused for another argv doesn't write into this one */
+	if (out == NULL) {
+		out = argv + 1;
+		out_cap = argc > 1 ? argc - 1 : 0;
+		in_place = true;
+	}
+
+	sub_simple_opt_iter_init(&it, argc, argv, options, values, idx, r);
+
+#ifdef SIMPLE_OPT_STATS
+	start = sub_simple_opt_stats_ns();
+#endif
+
+	while (simple_opt_next(&it) != SIMPLE_OPT_EVENT_END) {
+		if (it.event == SIMPLE_OPT_EVENT_ERROR)
+			break;
+
+		if (it.event != SIMPLE_OPT_EVENT_ARG)
+			continue;
+
+		if (command != NULL && (*command)->subcommands != NULL
+				&& !it.after_marker) {
+			if (!sub_simple_opt_command_enter(&it, command, r))
+				break;
+			continue;
+		}
+
+		if (r->argc + 1 > out_cap
+				|| (in_place && out + r->argc >= argv + it.st.i)) {
+			r->result_type = SIMPLE_OPT_RESULT_TOO_MANY_ARGS;
+			break;
+		}
+
+		out[r->argc] = it.arg;
+		r->argc++;
+	}
+
+#ifdef SIMPLE_OPT_STATS
+	SUB_SIMPLE_OPT_STAT_ADD(loop_ns, sub_simple_opt_stats_ns() - start);
+#endif
+
+	return r->result_type;
+}
+
+static struct simple_opt_result sub_simple_opt_parse_argv(int argc,
+		char **argv, struct simple_opt *options,
+		const struct simple_opt_index *idx)
+{
+	struct simple_opt_result r;
+	struct simple_opt_result_into ri;
+	size_t len;
+
+	ri.argv = r.argv;
+	ri.argv_cap = SIMPLE_OPT_MAX_ARGC;
+	ri.file = NULL;
+	ri.line = 0;
+	ri.option_string = NULL;
+	ri.argument_string = NULL;
+
+	/* there's nowhere to keep track of response files here, so they stay
+	 * loaded for the life of the program, as argv does */
+	ri.response_files = NULL;
+	ri.arena = NULL;
+
+	r.result_type = sub_simple_opt_parse_core(argc, argv, options, NULL, idx,
+			NULL, &ri);
+	r.option_type = ri.option_type;
+	r.option = ri.option;
+	r.argc = ri.argc;
+
+	if (ri.option_string != NULL) {
+		len = ri.option_string_len < SIMPLE_OPT_OPT_MAX_WIDTH - 1 ?
+			ri.option_string_len : SIMPLE_OPT_OPT_MAX_WIDTH - 1;
+		memcpy(r.option_string, ri.option_string, len);
+		r.option_string[len] = '\0';
+	}
+
+	if (ri.argument_string != NULL) {
+		strncpy(r.argument_string, ri.argument_string,
+				SIMPLE_OPT_OPT_ARG_MAX_WIDTH - 1);
+		r.argument_string[SIMPLE_OPT_OPT_ARG_MAX_WIDTH - 1] = '\0';
+	} else {
+		r.argument_string[0] = '\0';
+	}
+
+	return r;
+}
+
+static void simple_opt_lists_free(struct simple_opt *options)
+{
+	int i;
+
+	for (i = 0; options[i].type != SIMPLE_OPT_END; i++)
+		sub_simple_opt_list_reset(options + i, &options[i].val.v_list, NULL);
+}
+
+static void simple_opt_result_into_free(struct simple_opt_result_into *r)
+{
+	struct simple_opt_response_file *rf;
+
+	while (r->response_files != NULL) {
+		rf = r->response_files;
+		r->response_files = rf->next;
+
+#ifdef SUB_SIMPLE_OPT_MMAP
+		if (rf->is_mapped)
+			munmap(rf->buf, rf->size + 1);
+		else
+#endif
+			free(rf->buf);
+
+		free(rf);
+	}
+}
+
+static struct simple_opt_result simple_opt_parse(int argc, char **argv,
+		struct simple_opt *options)
+{
+	return sub_simple_opt_parse_argv(argc, argv, options, NULL);
+}
+
+static struct simple_opt_result simple_opt_parse_index(int argc, char **argv,
+		struct simple_opt_index *idx)
+{
+	return sub_simple_opt_parse_argv(argc, argv,
+			(struct simple_opt *)idx->options, idx);
+}
+
+static enum simple_opt_result_type simple_opt_parse_into(int argc,
+		char **argv, struct simple_opt *options,
+		struct simple_opt_result_into *r)
+{
+	return sub_simple_opt_parse_core(argc, argv, options, NULL, NULL, NULL, r);
+}
+
+static enum simple_opt_result_type simple_opt_parse_index_into(int argc,
+		char **argv, struct simple_opt_index *idx,
+		struct simple_opt_result_into *r)
+{
+	return sub_simple_opt_parse_core(argc, argv,
+			(struct simple_opt *)idx->options, NULL, idx, NULL, r);
+}
+
+/* options are only read while parsing into values, so they can be const */
+static enum simple_opt_result_type simple_opt_parse_values(int argc,
+		char **argv, const struct simple_opt *options,
+		struct simple_opt_value *values, struct simple_opt_result_into *r)
+{
+	return sub_simple_opt_parse_core(argc, argv, (struct simple_opt *)options,
+			values, NULL, NULL, r);
+}
+
+static enum simple_opt_result_type simple_opt_parse_index_values(int argc,
+		char **argv, const struct simple_opt_index *idx,
+		struct simple_opt_value *values, struct simple_opt_result_into *r)
+{
+	return sub_simple_opt_parse_core(argc, argv,
+			(struct simple_opt *)idx->options, values, idx, NULL, r);
+}
+
+/* leave the count values of options as if never parsed into, without
+ * freeing anything they hold */
+static void sub_simple_opt_values_clear(const struct simple_opt *options,
+		struct simple_opt_value *values, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		values[i].was_seen = false;
+		values[i].arg_is_stored = false;
+		values[i].source = SIMPLE_OPT_SOURCE_DEFAULT;
+
+		if (sub_simple_opt_is_list(options[i].type)) {
+			values[i].val.v_list.items.p = NULL;
+			values[i].val.v_list.count = 0;
+			values[i].val.v_list.cap = 0;
+			values[i].val.v_list.arena = NULL;
+		}
+	}
+}
+
+static void simple_opt_values_free(const struct simple_opt *options,
+		struct simple_opt_value *values)
+{
+	int i;
+
+	for (i = 0; options[i].type != SIMPLE_OPT_END; i++)
+		sub_simple_opt_list_reset(options + i, &values[i].val.v_list, NULL);
+
+	sub_simple_opt_values_clear(options, values, i);
+}
+
+/* parse a batch slot into cleared values, returning whether it failed */
+static bool sub_simple_opt_batch_parse(const struct simple_opt_index *idx,
+		struct simple_opt_batch_slot *slot)
+{
+	sub_simple_opt_values_clear(idx->options, slot->values, idx->count);
+
+	return simple_opt_parse_index_values(slot->argc, slot->argv, idx,
+			slot->values, &slot->result) != SIMPLE_OPT_RESULT_SUCCESS;
+}
+
+#ifdef SIMPLE_OPT_THREADS
+/* the number of slots a worker takes from its range at a time */
+#define SUB_SIMPLE_OPT_BATCH_CHUNK 32
+
+/* each worker starts with an even share of the slots, and once it's parsed
+ * them takes half of what's left to another, so that a worker held up by long
+ * command lines doesn't hold up the batch */
+struct sub_simple_opt_batch_worker {
+	pthread_t thread;
+	bool started;
+
+	/* the slots left to this worker, which other workers may take from the
+	 * end of */
+	pthread_mutex_t lock;
+	size_t next;
+	size_t end;
+
+	size_t failed;
+	const struct simple_opt_index *idx;
+	struct simple_opt_batch_slot *slots;
+	struct sub_simple_opt_batch_worker *workers;
+	int count;
+};
+
+/* take the second half of the slots left to the first other worker which has
+ * any, returning false if none have */
+static bool sub_simple_opt_batch_steal(struct sub_simple_opt_batch_worker *w)
+{
+	struct sub_simple_opt_batch_worker *v;
+	size_t lo, hi;
+	int k;
+
+	for (k = 1; k < w->count; k++) {
+		v = w->workers + (w - w->workers + k) % w->count;
+
+		pthread_mutex_lock(&v->lock);
+		lo = v->next + (v->end - v->next) / 2;
+		hi = v->end;
+		v->end = lo;
+		pthread_mutex_unlock(&v->lock);
+
+		if (lo != hi) {
+			pthread_mutex_lock(&w->lock);
+			w->next = lo;
+			w->end = hi;
+			pthread_mutex_unlock(&w->lock);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void *sub_simple_opt_batch_work(void *p)
+{
+	struct sub_simple_opt_batch_worker *w
+		= (struct sub_simple_opt_batch_worker *)p;
+	size_t i, lo, hi;
+
+	while (1) {
+		pthread_mutex_lock(&w->lock);
+		lo = w->next;
+		hi = w->end - lo > SUB_SIMPLE_OPT_BATCH_CHUNK ?
+			lo + SUB_SIMPLE_OPT_BATCH_CHUNK : w->end;
+		w->next = hi;
+		pthread_mutex_unlock(&w->lock);
+
+		if (lo == hi) {
+			if (!sub_simple_opt_batch_steal(w))
+				break;
+			continue;
+		}
+
+		for (i = lo; i < hi; i++)
+			w->failed += sub_simple_opt_batch_parse(w->idx, w->slots + i);
+	}
+
+	return NULL;
+}
+#endif
+
+static size_t simple_opt_parse_batch(const struct simple_opt_index *idx,
+		struct simple_opt_batch_slot *slots, size_t count, int threads)
+{
+	size_t i, failed = 0;
+#ifdef SIMPLE_OPT_THREADS
+	struct sub_simple_opt_batch_worker *workers;
+	size_t share;
+	int k;
+
+	if (threads <= 0) {
+#ifdef _SC_NPROCESSORS_ONLN
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+		if (threads <= 0)
+			threads = 1;
+	}
+
+	/* there's no point in a worker without a chunk of its own */
+	if ((size_t)threads > count / SUB_SIMPLE_OPT_BATCH_CHUNK)
+		threads = count / SUB_SIMPLE_OPT_BATCH_CHUNK;
+
+	if (threads > 1
+			&& (workers = (struct sub_simple_opt_batch_worker *)malloc(
+					threads * sizeof(*workers))) != NULL) {
+		share = count / threads;
+
+		for (k = 0; k < threads; k++) {
+			workers[k].next = k * share;
+			workers[k].end = k == threads - 1 ? count : (k + 1) * share;
+			workers[k].failed = 0;
+			workers[k].idx = idx;
+			workers[k].slots = slots;
+			workers[k].workers = workers;
+			workers[k].count = threads;
+			workers[k].started = false;
+			pthread_mutex_init(&workers[k].lock, NULL);
+		}
+
+		/* the calling thread is the first worker. a thread which can't be
+		 * started leaves its slots to be taken by the others */
+		for (k = 1; k < threads; k++)
+			workers[k].started = !pthread_create(&workers[k].thread, NULL,
+					sub_simple_opt_batch_work, workers + k);
+
+		sub_simple_opt_batch_work(workers);
+
+		/* every worker must finish before any lock goes, as they may still
+		 * be stealing from each other */
+		for (k = 1; k < threads; k++)
+			if (workers[k].started)
+				pthread_join(workers[k].thread, NULL);
+
+		for (k = 0; k < threads; k++) {
+			pthread_mutex_destroy(&workers[k].lock);
+			failed += workers[k].failed;
+		}
+
+		free(workers);
+		return failed;
+	}
+#else
+	(void)threads;
+#endif
+
+	for (i = 0; i < count; i++)
+		failed += sub_simple_opt_batch_parse(idx, slots + i);
+
+	return failed;
+}
+
+static enum simple_opt_result_type simple_opt_parse_command(int argc,
+		char **argv, struct simple_opt_command *root,
+		struct simple_opt_command **command, struct simple_opt_result_into *r)
+{
+	*command = root;
+
+	if (!sub_simple_opt_command_compile(root, r)) {
+		r->argc = 0;
+		r->option = NULL;
+		r->option_string = NULL;
+		r->argument_string = NULL;
+		return r->result_type;
+	}
+
+	return sub_simple_opt_parse_core(argc, argv, root->options, NULL,
+			&root->idx, command, r);
+}
+
+static void simple_opt_command_free(struct simple_opt_command *command)
+{
+	struct simple_opt_command *sub;
+
+	if (command->is_compiled)
+		simple_opt_index_free(&command->idx);
+
+	command->is_compiled = false;
+
+	for (sub = command->subcommands; sub != NULL && sub->name != NULL; sub++)
+		simple_opt_command_free(sub);
+}
+
+/* the character c becomes in an environment variable name made from a long
+ * name, so that "--dry-run" is read from "<prefix>DRY_RUN" */
+static unsigned char sub_simple_opt_env_char(char c)
+{
+	if (c == '-')
+		return '_';
+
+	return c >= 'a' && c <= 'z' ? c - 'a' + 'A' : (unsigned char)c;
+}
+
+/* the hash and length of the name of the environment variable o is read from,
+ * or false if it isn't read from one. names made from a prefix are hashed as
+ * they're made, rather than being stored */
+static bool sub_simple_opt_env_hash(const struct simple_opt *o,
+		const char *prefix, uint32_t *h, size_t *len)
+{
+	const char *c;
+
+	if (o->env_name != NULL) {
+		*len = strlen(o->env_name);
+		*h = sub_simple_opt_hash(o->env_name, *len);
+		return true;
+	}
+
+	if (prefix == NULL || o->long_name == NULL)
+		return false;
+
+	*h = 2166136261u;
+	*len = 0;
+
+	for (c = prefix; *c != '\0'; c++, (*len)++)
+		*h = (*h ^ (unsigned char)*c) * 16777619u;
+
+	for (c = o->long_name; *c != '\0'; c++, (*len)++)
+		*h = (*h ^ sub_simple_opt_env_char(*c)) * 16777619u;
+
+	return true;
+}
+
+/* whether the len chars at name are the name of o's environment variable */
+static bool sub_simple_opt_env_eq(const struct simple_opt *o,
+		const char *prefix, const char *name, size_t len)
+{
+	size_t i, prefix_len;
+
+	if (o->env_name != NULL)
+		return !memcmp(o->env_name, name, len);
+
+	prefix_len = strlen(prefix);
+	if (memcmp(prefix, name, prefix_len))
+		return false;
+
+	for (i = prefix_len; i < len; i++) {
+		if (sub_simple_opt_env_char(o->long_name[i - prefix_len])
+				!= (unsigned char)name[i])
+			return false;
+	}
+
+	return true;
+}
+
+/* give o the value s, of length len, from a source other than the cli, where
+ * values come with their names. a flag is set by an empty or true boolean
+ * value (or "1"), and cleared by a false one (or "0"), which still takes
+ * precedence over any lower source. any other option with an empty value is
+ * as if passed with no argument */
+static enum simple_opt_result_type sub_simple_opt_apply(struct simple_opt *o,
+		char *s, size_t len, enum simple_opt_source source,
+		struct simple_opt_arena *arena)
+{
+	struct simple_opt flag = { SIMPLE_OPT_BOOL, '\0', NULL, false, NULL, NULL,
+		NULL, false, NULL, false, false, SIMPLE_OPT_SOURCE_DEFAULT, { false } };
+	union simple_opt_value_val flag_val;
+	struct sub_simple_opt_state v = sub_simple_opt_own_state(o);
+	enum simple_opt_result_type rt;
+
+	if (*v.source > source)
+		return SIMPLE_OPT_RESULT_SUCCESS;
+
+	if (o->type == SIMPLE_OPT_FLAG) {
+		flag.type = SIMPLE_OPT_BOOL;
+		if (len == 1 && (s[0] == '0' || s[0] == '1'))
+			flag_val.v_bool = s[0] == '1';
+		else if (len > 0 && !sub_simple_opt_parse(&flag, &flag_val, s, len))
+			return SIMPLE_OPT_RESULT_BAD_ARG;
+
+		if (len == 0 || flag_val.v_bool) {
+			sub_simple_opt_seen(o, &v, source);
+		} else {
+			sub_simple_opt_unset(o, &v);
+			*v.count = 0;
+			*v.source = source;
+		}
+
+		return SIMPLE_OPT_RESULT_SUCCESS;
+	}
+
+	if (len == 0 && o->arg_is_required)
+		return SIMPLE_OPT_RESULT_MISSING_ARG;
+
+	sub_simple_opt_seen(o, &v, source);
+
+	if (len == 0)
+		return SIMPLE_OPT_RESULT_SUCCESS;
+
+	rt = sub_simple_opt_convert(o, &v, -1, s, len, NULL, arena);
+	if (rt == SIMPLE_OPT_RESULT_SUCCESS)
+		*v.arg_is_stored = true;
+
+	return rt;
+}
+
+static enum simple_opt_result_type simple_opt_parse_env(
+		struct simple_opt *options, const char *prefix, char **envp,
+		struct simple_opt_result_into *r)
+{
+	int i, count;
+	uint32_t size, mask, h, j;
+	size_t len, eq;
+	char **e;
+	struct simple_opt_index_slot *table, *slot;
+	struct sub_simple_opt_state v;
+
+	r->source = SIMPLE_OPT_SOURCE_ENV;
+	r->option = NULL;
+	r->option_string = NULL;
+	r->option_string_len = 0;
+	r->argument_string = NULL;
+
+	r->result_type = simple_opt_validate(options);
+	if (r->result_type != SIMPLE_OPT_RESULT_SUCCESS)
+		return r->result_type;
+
+#ifdef SUB_SIMPLE_OPT_ENVIRON
+	if (envp == NULL)
+		envp = SUB_SIMPLE_OPT_ENVIRON;
+#endif
+	if (envp == NULL)
+		return SIMPLE_OPT_RESULT_SUCCESS;
+
+	/* the names of the variables options are read from, hashed, so that the
+	 * environment is read in a single pass however many options there are */
+	for (count = 0; options[count].type != SIMPLE_OPT_END; count++);
+	for (size = 8; size < 2 * (uint32_t)count; size *= 2);
+	mask = size - 1;
+
+	if (r->arena != NULL)
+		table = (struct simple_opt_index_slot *)simple_opt_arena_alloc(
+				r->arena, size * sizeof(*table));
+	else
+		table = (struct simple_opt_index_slot *)malloc(
+				size * sizeof(*table));
+	if (table == NULL)
+		return r->result_type = SIMPLE_OPT_RESULT_OUT_OF_MEMORY;
+
+	for (j = 0; j < size; j++)
+		table[j].opt = -1;
+
+	for (i = 0; i < count; i++) {
+		if (!sub_simple_opt_env_hash(options + i, prefix, &h, &len))
+			continue;
+
+		/* lists in an arena may have been reset with it since they were
+		 * last read into */
+		if (r->arena != NULL
+				&& options[i].source == SIMPLE_OPT_SOURCE_ENV)
+			sub_simple_opt_list_reset(options + i, &options[i].val.v_list,
+					r->arena);
+
+		for (j = h & mask; table[j].opt != -1; j = (j + 1) & mask);
+		table[j].hash = h;
+		table[j].len = len;
+		table[j].opt = i;
+	}
+
+	for (e = envp; *e != NULL; e++) {
+		len = sub_simple_opt_scan(*e, &eq);
+		if (eq == len)
+			continue;
+
+		h = sub_simple_opt_hash(*e, eq);
+
+		for (j = h & mask; table[j].opt != -1; j = (j + 1) & mask) {
+			slot = table + j;
+
+			if (slot->hash != h || slot->len != eq || !sub_simple_opt_env_eq(
+						options + slot->opt, prefix, *e, eq))
+				continue;
+
+			/* a variable's value replaces, rather than adds to, what it
+			 * gave before */
+			if (options[slot->opt].source == SIMPLE_OPT_SOURCE_ENV) {
+				v = sub_simple_opt_own_state(options + slot->opt);
+				sub_simple_opt_unset(options + slot->opt, &v);
+			}
+
+			r->result_type = sub_simple_opt_apply(options + slot->opt,
+					*e + eq + 1, len - eq - 1, SIMPLE_OPT_SOURCE_ENV,
+					r->arena);
+
+			if (r->result_type != SIMPLE_OPT_RESULT_SUCCESS) {
+				r->option = options + slot->opt;
+				r->option_type = options[slot->opt].type;
+				r->option_string = *e;
+				r->option_string_len = eq;
+				r->argument_string = *e + eq + 1;
+				goto out;
+			}
+
+			/* only the first of any variables with the same name counts,
+			 * as with getenv */
+			slot->len = (uint32_t)-1;
+		}
+	}
+
+out:
+	if (r->arena == NULL)
+		free(table);
+
+	return r->result_type;
+}
+
+/* split the line between pos and end of a config file into a key and value,
+ * NUL-terminating each in place. a value in matching quotes has them removed,
+ * and a line without a "=" has no value. returns false if there's no key */
+static bool sub_simple_opt_config_line(char *pos, char *end, char **key,
+		size_t *key_len, char **value, size_t *value_len)
+{
+	char *eq, *key_end;
+
+	/* trailing whitespace can't hold the "=", so it's dropped after */
+	eq = (char *)memchr(pos, '=', end - pos);
+
+	while (end > pos && isspace((unsigned char)end[-1]))
+		end--;
+
+	key_end = eq != NULL ? eq : end;
+
+	while (key_end > pos && isspace((unsigned char)key_end[-1]))
+		key_end--;
+
+	if (key_end == pos)
+		return false;
+
+	*key = pos;
+	*key_len = key_end - pos;
+
+	if (eq == NULL) {
+		*value = end;
+		*value_len = 0;
+	} else {
+		for (*value = eq + 1; *value < end
+				&& isspace((unsigned char)**value); (*value)++);
+
+		if (end - *value >= 2 && (**value == '"' || **value == '\'')
+				&& end[-1] == **value) {
+			(*value)++;
+			end--;
+		}
+
+		*value_len = end - *value;
+	}
+
+	/* the key's terminator may overwrite the "=", so the value goes first */
+	*end = '\0';
+	(*key)[*key_len] = '\0';
+
+	return true;
+}
+
+static enum simple_opt_result_type simple_opt_parse_config(
+		struct simple_opt *options, const char *path,
+		struct simple_opt_result_into *r)
+{
+	int opt_i;
+	char *pos, *eol, *end, *key, *value;
+	size_t key_len, value_len;
+	struct simple_opt_index idx;
+	struct simple_opt_response_file *rf;
+
+	r->source = SIMPLE_OPT_SOURCE_CONFIG;
+	r->file = path;
+	r->line = 0;
+	r->option = NULL;
+	r->option_string = path;
+	r->option_string_len = strlen(path);
+	r->argument_string = NULL;
+
+	/* keys are looked up by long name through an index, which validates the
+	 * options as it's built */
+	r->result_type = sub_simple_opt_index_build(&idx, options, false);
+	if (r->result_type == SIMPLE_OPT_RESULT_OUT_OF_MEMORY)
+		return r->result_type;
+
+	if (r->result_type != SIMPLE_OPT_RESULT_SUCCESS)
+		goto out;
+
+	rf = sub_simple_opt_rfile_load(path, r->arena);
+	if (rf == NULL) {
+		r->result_type = SIMPLE_OPT_RESULT_BAD_CONFIG_FILE;
+		goto out;
+	}
+
+	if (r->arena == NULL) {
+		rf->next = r->response_files;
+		r->response_files = rf;
+	}
+
+	/* lists in an arena may have been reset with it since they were last
+	 * read into */
+	for (opt_i = 0; r->arena != NULL && opt_i < idx.count; opt_i++) {
+		if (options[opt_i].source == SIMPLE_OPT_SOURCE_CONFIG)
+			sub_simple_opt_list_reset(options + opt_i,
+					&options[opt_i].val.v_list, r->arena);
+	}
+
+	end = rf->buf + rf->size;
+	*end = '\0';
+
+	for (pos = rf->buf; pos < end; pos = eol + 1) {
+		r->line++;
+
+		eol = (char *)memchr(pos, '\n', end - pos);
+		if (eol == NULL)
+			eol = end;
+
+		while (pos < eol && isspace((unsigned char)*pos))
+			pos++;
+
+		/* blank lines and comments */
+		if (pos == eol || *pos == '#' || *pos == ';')
+			continue;
+
+		if (!sub_simple_opt_config_line(pos, eol, &key, &key_len, &value,
+					&value_len)) {
+			r->result_type = SIMPLE_OPT_RESULT_BAD_CONFIG_FILE;
+			r->option_string = pos;
+			r->option_string_len = eol - pos;
+			goto out;
+		}
+
+		r->option_string = key;
+		r->option_string_len = key_len;
+		r->argument_string = value;
+
+		opt_i = sub_simple_opt_index_long(key, key_len, &idx);
+		if (opt_i == -1) {
+			r->result_type = SIMPLE_OPT_RESULT_UNRECOGNISED_OPTION;
+			goto out;
+		}
+
+		r->result_type = sub_simple_opt_apply(options + opt_i, value,
+				value_len, SIMPLE_OPT_SOURCE_CONFIG, r->arena);
+
+		if (r->result_type != SIMPLE_OPT_RESULT_SUCCESS) {
+			r->option = options + opt_i;
+			r->option_type = options[opt_i].type;
+			goto out;
+		}
+	}
+
+out:
+	simple_opt_index_free(&idx);
+	return r->result_type;
+}
+
+/* snapshots of parsed options, as written by simple_opt_serialize, start with
+ * this header, in the byte order of the machine which wrote them. then for each
+ * option there's a byte of state (was_seen, arg_is_stored, and source shifted
+ * up by 2), a flag's count if it was seen, and its value if one is stored.
+ * numbers are stored as 8 bytes, and strings as a 4-byte length followed by
+ * the string and a NUL, so that they can be pointed to where they lie */
+#define SUB_SIMPLE_OPT_SNAPSHOT_VERSION 1
+#define SUB_SIMPLE_OPT_SNAPSHOT_HEADER 28
+
+/* FNV-1a, 64-bit, continuing from h */
+static uint64_t sub_simple_opt_fnv64(uint64_t h, const void *p, size_t len)
+{
+	const unsigned char *c = (const unsigned char *)p;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		h = (h ^ c[i]) * 1099511628211u;
+
+	return h;
+}
+
+/* a hash of everything about options which a snapshot of them depends on */
+static uint64_t sub_simple_opt_fingerprint(const struct simple_opt *options)
+{
+	uint64_t h = 14695981039346656037u;
+	unsigned char c[3];
+	int i, j;
+
+	for (i = 0; options[i].type != SIMPLE_OPT_END; i++) {
+		c[0] = options[i].type;
+		c[1] = options[i].short_name;
+		c[2] = options[i].arg_is_required;
+		h = sub_simple_opt_fnv64(h, c, 3);
+
+		if (options[i].long_name != NULL)
+			h = sub_simple_opt_fnv64(h, options[i].long_name,
+					strlen(options[i].long_name));
+		h = sub_simple_opt_fnv64(h, "", 1);
+
+		for (j = 0; options[i].type == SIMPLE_OPT_STRING_SET
+				&& options[i].string_set != NULL
+				&& options[i].string_set[j] != NULL; j++)
+			h = sub_simple_opt_fnv64(h, options[i].string_set[j],
+					strlen(options[i].string_set[j]) + 1);
+		h = sub_simple_opt_fnv64(h, "", 1);
+	}
+
+	return h;
+}
+
+/* a snapshot being written. everything is counted, but only written while it
+ * fits. failed is set if a length doesn't fit the 32 bits it's written in */
+struct sub_simple_opt_writer {
+	unsigned char *buf;
+	size_t size;
+	size_t len;
+	bool failed;
+};
+
+static void sub_simple_opt_put(struct sub_simple_opt_writer *w,
+		const void *p, size_t len)
+{
+	if (len <= w->size && w->len <= w->size - len)
+		memcpy(w->buf + w->len, p, len);
+
+	w->len += len;
+}
+
+/* write a count of 32 bits, failing if n doesn't fit */
+static void sub_simple_opt_put_count(struct sub_simple_opt_writer *w,
+		size_t n)
+{
+	uint32_t c = (uint32_t)n;
+
+	if (n > UINT32_MAX)
+		w->failed = true;
+
+	sub_simple_opt_put(w, &c, sizeof(c));
+}
+
+static void sub_simple_opt_put_string(struct sub_simple_opt_writer *w,
+		const char *s, size_t len)
+{
+	sub_simple_opt_put_count(w, len);
+	sub_simple_opt_put(w, s, len);
+	sub_simple_opt_put(w, "", 1);
+}
+
+static void sub_simple_opt_put_value(struct sub_simple_opt_writer *w,
+		const struct simple_opt *o)
+{
+	const struct simple_opt_list *l = &o->val.v_list;
+	unsigned char c;
+	int64_t i;
+	uint64_t u;
+	uint32_t n;
+	size_t k;
+
+	switch (o->type) {
+	case SIMPLE_OPT_BOOL:
+		c = o->val.v_bool;
+		sub_simple_opt_put(w, &c, 1);
+		break;
+	case SIMPLE_OPT_INT:
+		i = o->val.v_int;
+		sub_simple_opt_put(w, &i, sizeof(i));
+		break;
+	case SIMPLE_OPT_UNSIGNED:
+		u = o->val.v_unsigned;
+		sub_simple_opt_put(w, &u, sizeof(u));
+		break;
+	case SIMPLE_OPT_DOUBLE:
+		sub_simple_opt_put(w, &o->val.v_double, sizeof(double));
+		break;
+	case SIMPLE_OPT_CHAR:
+		sub_simple_opt_put(w, &o->val.v_char, 1);
+		break;
+	case SIMPLE_OPT_STRING:
+#ifdef SIMPLE_OPT_STRING_REF
+		sub_simple_opt_put_string(w, o->val.v_string.str,
+				o->val.v_string.len);
+#else
+		sub_simple_opt_put_string(w, o->val.v_string,
+				strlen(o->val.v_string));
+#endif
+		break;
+	case SIMPLE_OPT_STRING_SET:
+		n = o->val.v_string_set_idx;
+		sub_simple_opt_put(w, &n, sizeof(n));
+		break;
+	case SIMPLE_OPT_INT_LIST:
+	case SIMPLE_OPT_UNSIGNED_LIST:
+	case SIMPLE_OPT_DOUBLE_LIST:
+	case SIMPLE_OPT_STRING_LIST:
+		sub_simple_opt_put_count(w, l->count);
+
+		for (k = 0; k < l->count && !w->failed; k++) {
+			if (o->type == SIMPLE_OPT_INT_LIST) {
+				i = l->items.v_int[k];
+				sub_simple_opt_put(w, &i, sizeof(i));
+			} else if (o->type == SIMPLE_OPT_UNSIGNED_LIST) {
+				u = l->items.v_unsigned[k];
+				sub_simple_opt_put(w, &u, sizeof(u));
+			} else if (o->type == SIMPLE_OPT_DOUBLE_LIST) {
+				sub_simple_opt_put(w, l->items.v_double + k, sizeof(double));
+			} else {
+				sub_simple_opt_put_string(w, l->items.v_string[k],
+						strlen(l->items.v_string[k]));
+			}
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+static size_t simple_opt_serialize(const struct simple_opt *options,
+		void *buf, size_t size)
+{
+	struct sub_simple_opt_writer w;
+	uint16_t version = SUB_SIMPLE_OPT_SNAPSHOT_VERSION, order = 0x0102;
+	uint32_t count;
+	uint64_t fingerprint, len;
+	unsigned char state;
+	int i;
+
+	w.buf = (unsigned char *)buf;
+	w.size = size;
+	w.len = 0;
+	w.failed = false;
+
+	for (i = 0; options[i].type != SIMPLE_OPT_END; i++);
+	count = i;
+	fingerprint = sub_simple_opt_fingerprint(options);
+
+	sub_simple_opt_put(&w, "SOPT", 4);
+	sub_simple_opt_put(&w, &version, sizeof(version));
+	sub_simple_opt_put(&w, &order, sizeof(order));
+	sub_simple_opt_put(&w, &count, sizeof(count));
+	sub_simple_opt_put(&w, &fingerprint, sizeof(fingerprint));
+
+	/* the total length, filled in once it's known */
+	len = 0;
+	sub_simple_opt_put(&w, &len, sizeof(len));
+
+	for (i = 0; options[i].type != SIMPLE_OPT_END; i++) {
+		state = options[i].was_seen | options[i].arg_is_stored << 1
+			| options[i].source << 2;
+		sub_simple_opt_put(&w, &state, 1);
+
+		if (options[i].type == SIMPLE_OPT_FLAG && options[i].was_seen) {
+			len = options[i].val.v_count;
+			sub_simple_opt_put(&w, &len, sizeof(len));
+		}
+
+		if (options[i].arg_is_stored)
+			sub_simple_opt_put_value(&w, options + i);
+	}
+
+	/* the total length is left 0, so that whatever was written is rejected
+	 * as a snapshot */
+	if (w.failed)
+		return 0;
+
+	len = w.len;
+	if (w.len <= size)
+		memcpy(w.buf + SUB_SIMPLE_OPT_SNAPSHOT_HEADER - sizeof(len), &len,
+				sizeof(len));
+
+	return w.len;
+}
+
+/* a snapshot being read, and where values are being read into. with o NULL,
+ * it's only checked */
+struct sub_simple_opt_reader {
+	const unsigned char *buf;
+	size_t size;
+	size_t pos;
+	struct simple_opt *o;
+	struct simple_opt_arena *arena;
+};
+
+static bool sub_simple_opt_get(struct sub_simple_opt_reader *r, void *p,
+		size_t len)
+{
+	if (len > r->size - r->pos)
+		return false;
+
+	memcpy(p, r->buf + r->pos, len);
+	r->pos += len;
+	return true;
+}
+
+/* the next string in the snapshot, where it lies, and its length */
+static const char *sub_simple_opt_get_string(struct sub_simple_opt_reader *r,
+		size_t *len)
+{
+	uint32_t n;
+	const char *s;
+
+	if (!sub_simple_opt_get(r, &n, sizeof(n)) || n >= r->size - r->pos
+			|| r->buf[r->pos + n] != '\0')
+		return NULL;
+
+	s = (const char *)r->buf + r->pos;
+	r->pos += n + 1;
+	*len = n;
+	return s;
+}
+
+static bool sub_simple_opt_get_list(struct sub_simple_opt_reader *r,
+		const struct simple_opt *schema)
+{
+	struct simple_opt_list *l = r->o != NULL ? &r->o->val.v_list : NULL;
+	uint32_t n, k;
+	size_t len, size;
+	const char *s;
+	void *items = NULL;
+
+	if (!sub_simple_opt_get(r, &n, sizeof(n)))
+		return false;
+
+	size = schema->type == SIMPLE_OPT_INT_LIST ? sizeof(long)
+		: schema->type == SIMPLE_OPT_UNSIGNED_LIST ? sizeof(unsigned long)
+		: schema->type == SIMPLE_OPT_DOUBLE_LIST ? sizeof(double)
+		: sizeof(char *);
+
+	/* each item takes at least a byte, so a count past the end is bad, and
+	 * must not be allocated for */
+	if (n > r->size - r->pos)
+		return false;
+
+	if (l != NULL && n > 0) {
+		if (r->arena != NULL)
+			items = simple_opt_arena_alloc(r->arena, n * size);
+		else
+			items = malloc(n * size);
+		if (items == NULL)
+			return false;
+
+		l->items.p = items;
+		l->count = n;
+		l->cap = n;
+		l->arena = r->arena;
+	}
+
+	for (k = 0; k < n; k++) {
+		if (schema->type == SIMPLE_OPT_STRING_LIST) {
+			if ((s = sub_simple_opt_get_string(r, &len)) == NULL)
+				return false;
+			if (l != NULL)
+				l->items.v_string[k] = (char *)s;
+			continue;
+		}
+
+		/* numbers are 8 bytes, whatever their size here */
+		if (r->pos + 8 > r->size)
+			return false;
+
+		if (l != NULL && schema->type == SIMPLE_OPT_INT_LIST) {
+			int64_t i;
+			sub_simple_opt_get(r, &i, sizeof(i));
+			l->items.v_int[k] = i;
+		} else if (l != NULL && schema->type == SIMPLE_OPT_UNSIGNED_LIST) {
+			uint64_t u;
+			sub_simple_opt_get(r, &u, sizeof(u));
+			l->items.v_unsigned[k] = u;
+		} else if (l != NULL) {
+			sub_simple_opt_get(r, l->items.v_double + k, sizeof(double));
+		} else {
+			r->pos += 8;
+		}
+	}
+
+	return true;
+}
+
+/* read the value of an option of the same type as schema, into r->o if it's
+ * set */
+static bool sub_simple_opt_get_value(struct sub_simple_opt_reader *r,
+		const struct simple_opt *schema)
+{
+	struct simple_opt *o = r->o;
+	unsigned char c;
+	int64_t i;
+	uint64_t u;
+	uint32_t n;
+	double d;
+	size_t len;
+	const char *s;
+
+	switch (schema->type) {
+	case SIMPLE_OPT_BOOL:
+		if (!sub_simple_opt_get(r, &c, 1))
+			return false;
+		if (o != NULL)
+			o->val.v_bool = c;
+		return true;
+	case SIMPLE_OPT_INT:
+		if (!sub_simple_opt_get(r, &i, sizeof(i)))
+			return false;
+		if (o != NULL)
+			o->val.v_int = i;
+		return true;
+	case SIMPLE_OPT_UNSIGNED:
+		if (!sub_simple_opt_get(r, &u, sizeof(u)))
+			return false;
+		if (o != NULL)
+			o->val.v_unsigned = u;
+		return true;
+	case SIMPLE_OPT_DOUBLE:
+		if (!sub_simple_opt_get(r, &d, sizeof(d)))
+			return false;
+		if (o != NULL)
+			o->val.v_double = d;
+		return true;
+	case SIMPLE_OPT_CHAR:
+		if (!sub_simple_opt_get(r, &c, 1))
+			return false;
+		if (o != NULL)
+			o->val.v_char = c;
+		return true;
+	case SIMPLE_OPT_STRING:
+		if ((s = sub_simple_opt_get_string(r, &len)) == NULL)
+			return false;
+#ifdef SIMPLE_OPT_STRING_REF
+		if (o != NULL) {
+			o->val.v_string.str = (char *)s;
+			o->val.v_string.len = len;
+		}
+#else
+		if (len + 1 >= SIMPLE_OPT_OPT_ARG_MAX_WIDTH)
+			return false;
+		if (o != NULL)
+			memcpy(o->val.v_string, s, len + 1);
+#endif
+		return true;
+	case SIMPLE_OPT_STRING_SET:
+		if (!sub_simple_opt_get(r, &n, sizeof(n)))
+			return false;
+		for (i = 0; schema->string_set[i] != NULL; i++);
+		if (n >= i)
+			return false;
+		if (o != NULL)
+			o->val.v_string_set_idx = n;
+		return true;
+	case SIMPLE_OPT_INT_LIST:
+	case SIMPLE_OPT_UNSIGNED_LIST:
+	case SIMPLE_OPT_DOUBLE_LIST:
+	case SIMPLE_OPT_STRING_LIST:
+		return sub_simple_opt_get_list(r, schema);
+	default:
+		return true;
+	}
+}
+
+/* read every option's state from r, after the header */
+static bool sub_simple_opt_get_options(struct sub_simple_opt_reader *r,
+		struct simple_opt *options)
+{
+	struct sub_simple_opt_state v;
+	unsigned char state;
+	uint64_t count;
+	int i;
+
+	for (i = 0; options[i].type != SIMPLE_OPT_END; i++) {
+		if (!sub_simple_opt_get(r, &state, 1)
+				|| (state >> 2) > SIMPLE_OPT_SOURCE_CLI)
+			return false;
+
+		r->o = r->o != NULL ? options + i : NULL;
+		if (r->o != NULL) {
+			v = sub_simple_opt_own_state(r->o);
+			sub_simple_opt_unset(r->o, &v);
+			r->o->was_seen = state & 1;
+			r->o->arg_is_stored = (state >> 1) & 1;
+			r->o->source = (enum simple_opt_source)(state >> 2);
+		}
+
+		if (options[i].type == SIMPLE_OPT_FLAG && (state & 1)) {
+			if (!sub_simple_opt_get(r, &count, sizeof(count)))
+				return false;
+			if (r->o != NULL)
+				r->o->val.v_count = count;
+		}
+
+		if ((state & 2) && !sub_simple_opt_get_value(r, options + i))
+			return false;
+	}
+
+	return r->pos == r->size;
+}
+
+static enum simple_opt_result_type simple_opt_deserialize(
+		struct simple_opt *options, const void *buf, size_t size,
+		struct simple_opt_arena *arena)
+{
+	struct sub_simple_opt_reader r;
+	uint16_t version, order;
+	uint32_t count;
+	uint64_t fingerprint, len;
+	char magic[4];
+	int i;
+
+	r.buf = (const unsigned char *)buf;
+	r.size = size;
+	r.pos = 0;
+	r.o = NULL;
+	r.arena = arena;
+
+	for (i = 0; options[i].type != SIMPLE_OPT_END; i++);
+
+	if (!sub_simple_opt_get(&r, magic, 4) || memcmp(magic, "SOPT", 4)
+			|| !sub_simple_opt_get(&r, &version, sizeof(version))
+			|| version != SUB_SIMPLE_OPT_SNAPSHOT_VERSION
+			|| !sub_simple_opt_get(&r, &order, sizeof(order))
+			|| order != 0x0102
+			|| !sub_simple_opt_get(&r, &count, sizeof(count))
+			|| count != (uint32_t)i
+			|| !sub_simple_opt_get(&r, &fingerprint, sizeof(fingerprint))
+			|| fingerprint != sub_simple_opt_fingerprint(options)
+			|| !sub_simple_opt_get(&r, &len, sizeof(len))
+			|| len != size)
+		return SIMPLE_OPT_RESULT_BAD_SNAPSHOT;
+
+	/* check it all before changing anything, then read it for real */
+	if (!sub_simple_opt_get_options(&r, options))
+		return SIMPLE_OPT_RESULT_BAD_SNAPSHOT;
+
+	r.pos = SUB_SIMPLE_OPT_SNAPSHOT_HEADER;
+	r.o = options;
+
+	if (!sub_simple_opt_get_options(&r, options))
+		return SIMPLE_OPT_RESULT_OUT_OF_MEMORY;
+
+	return SIMPLE_OPT_RESULT_SUCCESS;
+}
+
+/* output for usage and error printing is rendered into one of these, then
+ * written out all at once, rather than being passed to stdio a character at a
+ * time */
+struct sub_simple_opt_buf {
+	char *s;
+
+	/* how much has been rendered. if the buffer is fixed, this counts output
+	 * past cap which was dropped */
+	size_t len;
+	size_t cap;
+
+	/* a fixed buffer belongs to the caller and can't be grown */
+	bool fixed;
+	bool on_heap;
+
+	/* where a growable buffer is written out to. if NULL, the buffer is only
+	 * kept in memory, and failed is set if it couldn't be grown */
+	FILE *f;
+	bool failed;
+};
+
+static bool sub_simple_opt_buf_reserve(struct sub_simple_opt_buf *b,
+		size_t n)
+{
+	size_t cap;
+	char *p;
+
+	if (b->len + n <= b->cap)
+		return true;
+
+	if (b->fixed)
+		return false;
+
+	for (cap = b->cap > 0 ? b->cap * 2 : 256; cap < b->len + n; cap *= 2);
+
+	p = (char *)(b->on_heap ? realloc(b->s, cap) : malloc(cap));
+	if (p != NULL) {
+		if (!b->on_heap && b->len > 0)
+			memcpy(p, b->s, b->len);
+
+		b->s = p;
+		b->cap = cap;
+		b->on_heap = true;
+		return true;
+	}
+
+	if (b->f == NULL) {
+		b->failed = true;
+		return false;
+	}
+
+	/* no memory to grow into, so write out what there is and start over */
+	fwrite(b->s, 1, b->len, b->f);
+	b->len = 0;
+
+	return n <= b->cap;
+}
+
+static void sub_simple_opt_buf_putn(struct sub_simple_opt_buf *b,
+		const char *s, size_t n)
+{
+	if (sub_simple_opt_buf_reserve(b, n)) {
+		memcpy(b->s + b->len, s, n);
+	} else if (!b->fixed && b->f != NULL) {
+		fwrite(s, 1, n, b->f);
+		return;
+	} else if (b->len < b->cap) {
+		memcpy(b->s + b->len, s, b->cap - b->len);
+	}
+
+	b->len += n;
+}
+
+static void sub_simple_opt_buf_putc(struct sub_simple_opt_buf *b, char c)
+{
+	if (b->len < b->cap)
+		b->s[b->len++] = c;
+	else
+		sub_simple_opt_buf_putn(b, &c, 1);
+}
+
+static void sub_simple_opt_buf_puts(struct sub_simple_opt_buf *b,
+		const char *s)
+{
+	sub_simple_opt_buf_putn(b, s, strlen(s));
+}
+
+static void sub_simple_opt_buf_init_file(struct sub_simple_opt_buf *b,
+		FILE *f, char *stack_buf, size_t size)
+{
+	b->s = stack_buf;
+	b->len = 0;
+	b->cap = size;
+	b->fixed = false;
+	b->on_heap = false;
+	b->f = f;
+	b->failed = false;
+}
+
+static void sub_simple_opt_buf_init_fixed(struct sub_simple_opt_buf *b,
+		char *buf, size_t len)
+{
+	/* leave space for a NUL */
+	b->s = len > 0 ? buf : NULL;
+	b->len = 0;
+	b->cap = len > 0 ? len - 1 : 0;
+	b->fixed = true;
+	b->on_heap = false;
+	b->f = NULL;
+	b->failed = false;
+}
+
+/* write out a growable buffer, or NUL-terminate a fixed one, returning the
+ * length of everything rendered */
+static size_t sub_simple_opt_buf_finish(struct sub_simple_opt_buf *b)
+{
+	if (b->fixed) {
+		if (b->s != NULL)
+			b->s[b->len < b->cap ? b->len : b->cap] = '\0';
+		return b->len;
+	}
+
+	fwrite(b->s, 1, b->len, b->f);
+
+	if (b->on_heap)
+		free(b->s);
+
+	return b->len;
+}
+
+/* print t->s, wrapping at words. if t->words is NULL, s is split into words as
+ * it's printed, otherwise the words given are used */
+static int sub_simple_opt_wrap_text(struct sub_simple_opt_buf *b,
+		unsigned width, unsigned col, unsigned line_start,
+		const struct simple_opt_help_text *t)
+{
+	bool add_newline = false, first_word = true, first_line = true;
+	unsigned i, j, word_start, word_end;
+	const char *s = t->s;
+	uint32_t word_i = 0;
+
+	if (width != 0 && line_start >= width) {
+		line_start = 0;
+		add_newline = true;
+	}
+
+	if (width != 0 && col >= width)
+		add_newline = true;
+
+	if (add_newline) {
+		sub_simple_opt_buf_putc(b, '\n');
+		col = 0;
+		first_line = false;
+	}
+
+	/* print out the message, trying to wrap at words */
+	word_start = 0;
+	while (1) {
+		/* find the next word */
+		if (t->words != NULL) {
+			if (word_i == t->nwords)
+				return col;
+
+			word_start = t->words[word_i].start;
+			word_end = word_start + t->words[word_i].len;
+			word_i++;
+		} else {
+			while ( isspace(s[word_start]) )
+				word_start++;
+
+			/* null appeared before any non-spaces */
+			if (s[word_start] == '\0')
+				return col;
+
+			word_end = word_start;
+			while ( (s[word_end] != '\0') && !isspace(s[word_end]) )
+				word_end++;
+		}
+
+		/* buffer up to line_start with spaces */
+		while (col < line_start + 2 * (!first_line && width > 40
+					&& line_start > 5)) {
+			sub_simple_opt_buf_putc(b, ' ');
+			col++;
+		}
+
+		/* if too little space left, wrap */
+		if (width != 0 && col + (word_end - word_start) + (first_word ? 0 : 1)
+				> width && first_word == false) {
+			sub_simple_opt_buf_putc(b, '\n');
+			first_line = false;
+			/* buffer up to line_start with spaces */
+			col = 0;
+			while (col < line_start + 2 * (!first_line && width > 40
+						&& line_start > 5)) {
+				sub_simple_opt_buf_putc(b, ' ');
+				col++;
+			}
+			first_word = true;
+		} 
+		
+		if (first_word == false) {
+			sub_simple_opt_buf_putc(b, ' ');
+			col++;
+		}
+
+		/* if too long, print piecemeal */
+		if (width != 0 && (line_start + (word_end - word_start) > width
+					|| (first_word && col + (word_end - word_start) > width)) ) {
+			j = word_start;
+			while (1) {
+				i = col >= width ? 0 : word_end - j < width - col ?
+					word_end - j : width - col;
+				sub_simple_opt_buf_putn(b, s + j, i);
+				j += i;
+				col += i;
+
+				if (j == word_end)
+					break;
+
+				col = 0;
+				sub_simple_opt_buf_putc(b, '\n');
+				first_line = false;
+				while (col < line_start + 2 * (!first_line && width > 40
+							&& line_start > 5)) {
+					sub_simple_opt_buf_putc(b, ' ');
+					col++;
+				}
+			}
+		/* else just print and move to the next word */
+		} else {
+			sub_simple_opt_buf_putn(b, s + word_start, word_end - word_start);
+			col += word_end - word_start;
+		}
+
+		word_start = word_end;
+		first_word = false;
+	}
+
+	return col;
+}
+
+static int sub_simple_opt_wrap_print(struct sub_simple_opt_buf *b,
+		unsigned width, unsigned col, unsigned line_start, const char *s)
+{
+	struct simple_opt_help_text t;
+
+	t.s = s;
+	t.words = NULL;
+	t.nwords = 0;
+
+	return sub_simple_opt_wrap_text(b, width, col, line_start, &t);
+}
+
+/* the width of column 2 of an option's usage line (long_name and type), or
+ * possibly one more */
+static size_t sub_simple_opt_col2_width(const struct simple_opt *o)
+{
+	size_t j = 0;
+
+	/* 3 for "--" and "=" */
+	if (o->long_name != NULL)
+		j += 3 + strlen(o->long_name);
+
+	/* 2 for optional args, where arg is wrapped in [] */
+	if (!o->arg_is_required && o->type != SIMPLE_OPT_FLAG)
+		j += 2;
+
+	/* the width of the arg type string (BOOL, INT, UNSIGNED, STRING etc)
+	 * FLAGs don't take an argument, so 0 */
+	if (o->type != SIMPLE_OPT_FLAG) {
+		/* if there's a custom string, use that width. else, use one of the
+		 * default widths */
+		if (o->custom_arg_string != NULL) {
+			j += strlen(o->custom_arg_string);
+		} else {
+			switch (o->type) {
+			case SIMPLE_OPT_BOOL:
+				j += 4;
+				break;
+			case SIMPLE_OPT_INT:
+			case SIMPLE_OPT_INT_LIST:
+				j += 3;
+				break;
+			case SIMPLE_OPT_UNSIGNED:
+			case SIMPLE_OPT_UNSIGNED_LIST:
+				j += 8;
+				break;
+			case SIMPLE_OPT_DOUBLE:
+			case SIMPLE_OPT_DOUBLE_LIST:
+				j += 6;
+				break;
+			case SIMPLE_OPT_CHAR:
+				j += 4;
+				break;
+			case SIMPLE_OPT_STRING:
+			case SIMPLE_OPT_STRING_SET:
+			case SIMPLE_OPT_STRING_LIST:
+				j += 6;
+				break;
+			default:
+				break;
+			}
+		}
+	}
+
+	return j;
+}
+
+/* the column at which option descriptions start, before it's limited by the
+ * output width */
+static unsigned sub_simple_opt_desc_line_start(const struct simple_opt *options)
+{
+	unsigned i, desc_line_start;
+
+	/* 4 to start with, leaving space for "  -X " */
+	desc_line_start = 5;
+
+	for (i = 0; options[i].type != SIMPLE_OPT_END; i++) {
+		/* 5 for leading "  -X ", 2 for trailing " " */
+		if (desc_line_start < sub_simple_opt_col2_width(options + i) + 5 + 2)
+			desc_line_start = sub_simple_opt_col2_width(options + i) + 5 + 2;
+	}
+
+	return desc_line_start;
+}
+
+/* how o's argument is shown in usage (BOOL, INT, UNSIGNED, STRING etc) */
+static const char *sub_simple_opt_arg_name(const struct simple_opt *o)
+{
+	if (o->custom_arg_string != NULL)
+		return o->custom_arg_string;
+
+	switch (o->type) {
+	case SIMPLE_OPT_BOOL:
+		return "BOOL";
+	case SIMPLE_OPT_INT:
+	case SIMPLE_OPT_INT_LIST:
+		return "INT";
+	case SIMPLE_OPT_UNSIGNED:
+	case SIMPLE_OPT_UNSIGNED_LIST:
+		return "UNSIGNED";
+	case SIMPLE_OPT_DOUBLE:
+	case SIMPLE_OPT_DOUBLE_LIST:
+		return "DOUBLE";
+	case SIMPLE_OPT_CHAR:
+		return "CHAR";
+	case SIMPLE_OPT_STRING:
+	case SIMPLE_OPT_STRING_SET:
+	case SIMPLE_OPT_STRING_LIST:
+		return "STRING";
+	default:
+		return "";
+	}
+}
+
+/* render column 2 of an option's usage line */
+static void sub_simple_opt_render_col2(struct sub_simple_opt_buf *b,
+		const struct simple_opt *o)
+{
+	if (o->long_name != NULL) {
+		sub_simple_opt_buf_puts(b, "--");
+		sub_simple_opt_buf_puts(b, o->long_name);
+	}
+
+	if (!o->arg_is_required && o->type != SIMPLE_OPT_FLAG)
+		sub_simple_opt_buf_putc(b, '[');
+
+	if (o->long_name != NULL && o->type != SIMPLE_OPT_FLAG)
+		sub_simple_opt_buf_putc(b, '=');
+
+	if (o->type != SIMPLE_OPT_FLAG)
+		sub_simple_opt_buf_puts(b, sub_simple_opt_arg_name(o));
+
+	if (!o->arg_is_required && o->type != SIMPLE_OPT_FLAG)
+		sub_simple_opt_buf_putc(b, ']');
+}
+
+/* print the "Usage:" and summary lines, if there are any */
+static void sub_simple_opt_render_head(struct sub_simple_opt_buf *b,
+		unsigned width, const struct simple_opt_help_text *command_name,
+		size_t command_name_len,
+		const struct simple_opt_help_text *command_options,
+		const struct simple_opt_help_text *command_summary)
+{
+	unsigned col;
+
+	/* print "Usage: <exec> <options> */
+	if (command_name->s != NULL && command_options->s != NULL) {
+		col = sub_simple_opt_wrap_print(b, width, 0, 0, "Usage:");
+
+		col = sub_simple_opt_wrap_text(b, width, col, 7, command_name);
+
+		sub_simple_opt_wrap_text(b, width, col, 7 + command_name_len + 1,
+				command_options);
+
+		sub_simple_opt_buf_puts(b, "\n\n");
+	}
+
+	/* print summary line */
+	if (command_summary->s != NULL) {
+		sub_simple_opt_wrap_text(b, width, 0, 2, command_summary);
+		sub_simple_opt_buf_puts(b, "\n\n");
+	}
+}
+
+/* print an option's line of the usage message */
+static void sub_simple_opt_render_row(struct sub_simple_opt_buf *b,
+		unsigned width, unsigned desc_line_start,
+		const struct simple_opt_help_text *col1,
+		const struct simple_opt_help_text *col2,
+		const struct simple_opt_help_text *description)
+{
+	unsigned col;
+
+	/* print column 1 (short name) */
+	col = sub_simple_opt_wrap_text(b, width, 0, 2, col1);
+
+	/* print column 2 (long_name and type). 5 for "  -X --" */
+	col = sub_simple_opt_wrap_text(b, width, col, 5, col2);
+
+	/* print option description */
+	if (description->s != NULL) {
+		if (col < width) {
+			sub_simple_opt_buf_putc(b, ' ');
+			col++;
+		}
+		if (col < width) {
+			sub_simple_opt_buf_putc(b, ' ');
+			col++;
+		}
+		sub_simple_opt_wrap_text(b, width, col, desc_line_start,
+				description);
+	}
+
+	/* end of this option */
+	sub_simple_opt_buf_putc(b, '\n');
+}
+
+/* desc_line_start is as given by sub_simple_opt_desc_line_start for options.
+ * with subcommands, they're listed after the options */
+static void sub_simple_opt_render_usage(struct sub_simple_opt_buf *b,
+		unsigned width, char *command_name, char *command_options,
+		char *command_summary, struct simple_opt *options,
+		const struct simple_opt_command *subcommands, unsigned desc_line_start)
+{
+	char print_buffer[SIMPLE_OPT_PRINT_BUFFER_WIDTH];
+	char col1_buffer[3];
+	unsigned i;
+	struct simple_opt_help_text name, opts, summary, col1, col2, desc;
+	struct sub_simple_opt_buf col2_buf;
+
+	/* leave space for the widest subcommand name, after "  " and before " " */
+	for (i = 0; subcommands != NULL && subcommands[i].name != NULL; i++) {
+		if (desc_line_start < strlen(subcommands[i].name) + 2 + 2)
+			desc_line_start = strlen(subcommands[i].name) + 2 + 2;
+	}
+
+	/* check for space for long_name printing */
+	if (desc_line_start >= SIMPLE_OPT_PRINT_BUFFER_WIDTH + 5 + 2) {
+		sub_simple_opt_buf_puts(b,
+				"simple-opt internal err: usage print buffer too small\n");
+		return;
+	}
+
+	/* if the desc_line_start is so far over it threatens readability, move it
+	 * back a bit and just let the offending longer args be offset */
+	if (desc_line_start > (width / 2 < 30 ? width / 2 : 30))
+		desc_line_start = (width / 2 < 30 ? width / 2 : 30);
+
+
+
+	/* 
+	 * printing 
+	 *
+	 */
+
+	name.s = command_name;
+	opts.s = command_options;
+	summary.s = command_summary;
+	col1.s = col1_buffer;
+	col2.s = print_buffer;
+	name.words = opts.words = summary.words = col1.words = col2.words
+		= desc.words = NULL;
+
+	sub_simple_opt_render_head(b, width, &name,
+			command_name != NULL ? strlen(command_name) : 0, &opts, &summary);
+
+	/* print option list */
+	for (i = 0; options[i].type != SIMPLE_OPT_END; i++) {
+		col1_buffer[0] = '-';
+		col1_buffer[1] = options[i].short_name;
+		col1_buffer[2] = '\0';
+		if (options[i].short_name == '\0')
+			col1_buffer[0] = '\0';
+
+		sub_simple_opt_buf_init_fixed(&col2_buf, print_buffer,
+				sizeof(print_buffer));
+		sub_simple_opt_render_col2(&col2_buf, options + i);
+		sub_simple_opt_buf_finish(&col2_buf);
+
+		desc.s = options[i].description;
+
+		sub_simple_opt_render_row(b, width, desc_line_start, &col1, &col2,
+				&desc);
+	}
+
+	if (subcommands == NULL)
+		return;
+
+	/* print subcommand list, each name taking the place of the short and
+	 * long names */
+	if (options[0].type != SIMPLE_OPT_END)
+		sub_simple_opt_buf_putc(b, '\n');
+	sub_simple_opt_buf_puts(b, "Commands:\n");
+
+	col2.s = "";
+	for (i = 0; subcommands[i].name != NULL; i++) {
+		col1.s = subcommands[i].name;
+		desc.s = subcommands[i].description;
+
+		sub_simple_opt_render_row(b, width, desc_line_start, &col1, &col2,
+				&desc);
+	}
+}
+
+static void sub_simple_opt_render_error(struct sub_simple_opt_buf *b,
+		unsigned width, char *command_name,
+		const struct simple_opt_result_into *result)
+{
+	char print_buffer[SIMPLE_OPT_PRINT_BUFFER_WIDTH];
+	char where[SIMPLE_OPT_PRINT_BUFFER_WIDTH];
+	unsigned i, line_start, col;
+	int rval;
+
+	/* just easier to write */
+	const size_t size = SIMPLE_OPT_PRINT_BUFFER_WIDTH;
+
+	if (result->result_type == SIMPLE_OPT_RESULT_SUCCESS)
+		return;
+
+	if (command_name != NULL)
+		rval = snprintf(print_buffer, size, "%s:", command_name);
+	else
+		rval = snprintf(print_buffer, size, "err:");
+
+	if (rval < 0 || (unsigned)rval >= size) {
+		sub_simple_opt_buf_puts(b, "simple-opt internal err: print buffer too small\n");
+		return;
+	}
+
+	col = sub_simple_opt_wrap_print(b, width, 0, 0, print_buffer);
+
+	line_start = strlen(print_buffer) + 1;
+
+	/* errors in a config file are prefixed with where in it they are */
+	where[0] = '\0';
+	if (result->source == SIMPLE_OPT_SOURCE_CONFIG && result->line > 0) {
+		rval = snprintf(where, size, "%s:%lu: ", result->file, result->line);
+
+		if (rval < 0 || (unsigned)rval >= size) {
+			sub_simple_opt_buf_puts(b, "simple-opt internal err: print buffer too small\n");
+			return;
+		}
+	}
+
+	switch (result->result_type) {
+	case SIMPLE_OPT_RESULT_UNRECOGNISED_OPTION:
+		rval = snprintf(print_buffer, size, "%sunrecognised option `%.*s`",
+				where, (int)result->option_string_len,
+				result->option_string);
+		break;
+
+	case SIMPLE_OPT_RESULT_BAD_ARG:
+		if (result->source == SIMPLE_OPT_SOURCE_ENV)
+			rval = snprintf(print_buffer, size,
+					"bad value `%s` in environment variable `%.*s`",
+					result->argument_string,
+					(int)result->option_string_len, result->option_string);
+		else
+			rval = snprintf(print_buffer, size,
+					"%sbad argument `%s` passed to option `%.*s`", where,
+					result->argument_string,
+					(int)result->option_string_len, result->option_string);
+
+		if (rval < 0 || (unsigned)rval >= size) {
+			sub_simple_opt_buf_puts(b, "simple-opt internal err: print buffer too small\n");
+			return;
+		}
+
+		sub_simple_opt_wrap_print(b, width, col, line_start,
+				print_buffer);
+		sub_simple_opt_buf_putc(b, '\n');
+		col = 0;
+
+		switch (result->option_type) {
+		case SIMPLE_OPT_FLAG:
+		case SIMPLE_OPT_BOOL:
 			rval = snprintf(print_buffer, size,
 					"expected a boolean: (yes|true|on) or (no|false|off)");
 			break;
 		case SIMPLE_OPT_INT:
+		case SIMPLE_OPT_INT_LIST:
 			rval = snprintf(print_buffer, size,"expected integer value");
 			break;
 		case SIMPLE_OPT_UNSIGNED:
+		case SIMPLE_OPT_UNSIGNED_LIST:
 			rval = snprintf(print_buffer, size,
 					"expected unsigned integer value");
 			break;
 		case SIMPLE_OPT_DOUBLE:
+		case SIMPLE_OPT_DOUBLE_LIST:
 			rval = snprintf(print_buffer, size,
 					"expected floating-point value");
 			break;
@@ -848,28 +4613,28 @@ static void simple_opt_print_error(FILE *f, unsigned width, char *command_name,
 					"expected a string");
 			break;
 		case SIMPLE_OPT_STRING_SET:
-			for (i = 0; result.option->string_set[i] != NULL; i++);
+			for (i = 0; result->option->string_set[i] != NULL; i++);
 			if (i == 1) {
 				rval = snprintf(print_buffer, size, "expected \"%s\"",
-						result.option->string_set[0]);
+						result->option->string_set[0]);
 			} else if (i == 2) {
 				rval = snprintf(print_buffer, size,
 						"expected \"%s\" or \"%s\"",
-						result.option->string_set[0],
-						result.option->string_set[1]);
+						result->option->string_set[0],
+						result->option->string_set[1]);
 			} else if (i == 3) {
 				rval = snprintf(print_buffer, size,
 						"expected \"%s\", \"%s\" or \"%s\"",
-						result.option->string_set[0],
-						result.option->string_set[1],
-						result.option->string_set[2]);
+						result->option->string_set[0],
+						result->option->string_set[1],
+						result->option->string_set[2]);
 			} else if (i == 4) {
 				rval = snprintf(print_buffer, size,
 						"expected \"%s\", \"%s\", \"%s\", or \"%s\"",
-						result.option->string_set[0],
-						result.option->string_set[1],
-						result.option->string_set[2],
-						result.option->string_set[3]);
+						result->option->string_set[0],
+						result->option->string_set[1],
+						result->option->string_set[2],
+						result->option->string_set[3]);
 			} else {
 				rval = snprintf(print_buffer, size,
 						"expected one of %u possibile strings", i);
@@ -877,41 +4642,1023 @@ static void simple_opt_print_error(FILE *f, unsigned width, char *command_name,
 		default:
 			break;
 		}
-		break;
+		break;
+
+	case SIMPLE_OPT_RESULT_MISSING_ARG:
+		if (result->source == SIMPLE_OPT_SOURCE_ENV)
+			rval = snprintf(print_buffer, size,
+					"value expected in environment variable `%.*s`",
+					(int)result->option_string_len, result->option_string);
+		else
+			rval = snprintf(print_buffer, size,
+					"%sargument expected for option `%.*s`", where,
+					(int)result->option_string_len, result->option_string);
+		break;
+
+	case SIMPLE_OPT_RESULT_AMBIGUOUS_OPTION:
+		rval = snprintf(print_buffer, size,
+				"option `%.*s` is ambiguous",
+				(int)result->option_string_len, result->option_string);
+		break;
+
+	case SIMPLE_OPT_RESULT_UNRECOGNISED_COMMAND:
+		rval = snprintf(print_buffer, size, "unrecognised command `%.*s`",
+				(int)result->option_string_len, result->option_string);
+		break;
+
+	case SIMPLE_OPT_RESULT_OPT_ARG_TOO_LONG:
+		if (result->source == SIMPLE_OPT_SOURCE_ENV)
+			rval = snprintf(print_buffer, size,
+					"value of environment variable `%.*s` is too long",
+					(int)result->option_string_len, result->option_string);
+		else
+			rval = snprintf(print_buffer, size,
+					"%sargument passed to option `%.*s` is too long", where,
+					(int)result->option_string_len, result->option_string);
+		break;
+
+	case SIMPLE_OPT_RESULT_TOO_MANY_ARGS:
+		rval = snprintf(print_buffer, size,
+				"too many cli arguments received");
+		break;
+
+	case SIMPLE_OPT_RESULT_MALFORMED_OPTION_STRUCT:
+		rval = snprintf(print_buffer, size,
+				"malformed option struct (internal err)");
+		break;
+
+	case SIMPLE_OPT_RESULT_OUT_OF_MEMORY:
+		rval = snprintf(print_buffer, size,
+				"out of memory (internal err)");
+		break;
+
+	case SIMPLE_OPT_RESULT_BAD_RESPONSE_FILE:
+		/* a file which was read says what was wrong with it */
+		if (result->argument_string != NULL
+				&& result->argument_string[0] != '\0')
+			rval = snprintf(print_buffer, size,
+					"response file `%.*s` %s",
+					(int)result->option_string_len - 1,
+					result->option_string + 1, result->argument_string);
+		else
+			rval = snprintf(print_buffer, size,
+					"unable to read response file `%.*s`",
+					(int)result->option_string_len - 1,
+					result->option_string + 1);
+		break;
+
+	case SIMPLE_OPT_RESULT_BAD_SNAPSHOT:
+		rval = snprintf(print_buffer, size,
+				"snapshot doesn't match the options (internal err)");
+		break;
+
+	case SIMPLE_OPT_RESULT_BAD_CONFIG_FILE:
+		if (result->line > 0)
+			rval = snprintf(print_buffer, size,
+					"%sexpected `<option> = <value>`", where);
+		else
+			rval = snprintf(print_buffer, size,
+					"unable to read config file `%s`",
+					result->file != NULL ? result->file : "");
+		break;
+
+	default:
+		break;
+	}
+
+	if (rval < 0 || (unsigned)rval >= size) {
+		sub_simple_opt_buf_puts(b, "simple-opt internal err: print buffer too small");
+		return;
+	}
+
+	sub_simple_opt_wrap_print(b, width, col, line_start, print_buffer);
+	sub_simple_opt_buf_putc(b, '\n');
+}
+
+static void simple_opt_print_usage(FILE *f, unsigned width,
+		char *command_name, char *command_options, char *command_summary,
+		struct simple_opt *options)
+{
+	char stack_buf[SIMPLE_OPT_PRINT_BUFFER_WIDTH];
+	struct sub_simple_opt_buf b;
+
+	sub_simple_opt_buf_init_file(&b, f, stack_buf, sizeof(stack_buf));
+	sub_simple_opt_render_usage(&b, width, command_name, command_options,
+			command_summary, options, NULL,
+			sub_simple_opt_desc_line_start(options));
+	sub_simple_opt_buf_finish(&b);
+}
+
+static size_t simple_opt_render_usage(char *buf, size_t len, unsigned width,
+		char *command_name, char *command_options, char *command_summary,
+		struct simple_opt *options)
+{
+	struct sub_simple_opt_buf b;
+
+	sub_simple_opt_buf_init_fixed(&b, buf, len);
+	sub_simple_opt_render_usage(&b, width, command_name, command_options,
+			command_summary, options, NULL,
+			sub_simple_opt_desc_line_start(options));
+	return sub_simple_opt_buf_finish(&b);
+}
+
+/* the description of a command is its summary, and it's followed by its
+ * subcommands */
+static void simple_opt_print_command_usage(FILE *f, unsigned width,
+		char *command_name, char *command_options,
+		struct simple_opt_command *command)
+{
+	char stack_buf[SIMPLE_OPT_PRINT_BUFFER_WIDTH];
+	struct sub_simple_opt_buf b;
+
+	sub_simple_opt_buf_init_file(&b, f, stack_buf, sizeof(stack_buf));
+	sub_simple_opt_render_usage(&b, width, command_name, command_options,
+			(char *)command->description, command->options,
+			command->subcommands,
+			sub_simple_opt_desc_line_start(command->options));
+	sub_simple_opt_buf_finish(&b);
+}
+
+static size_t simple_opt_render_command_usage(char *buf, size_t len,
+		unsigned width, char *command_name, char *command_options,
+		struct simple_opt_command *command)
+{
+	struct sub_simple_opt_buf b;
+
+	sub_simple_opt_buf_init_fixed(&b, buf, len);
+	sub_simple_opt_render_usage(&b, width, command_name, command_options,
+			(char *)command->description, command->options,
+			command->subcommands,
+			sub_simple_opt_desc_line_start(command->options));
+	return sub_simple_opt_buf_finish(&b);
+}
+
+/* split t->s into words, storing them at *words (if it isn't NULL) and
+ * advancing it. returns the number of words */
+static uint32_t sub_simple_opt_help_split(struct simple_opt_help_text *t,
+		struct simple_opt_help_word **words)
+{
+	uint32_t i = 0, n = 0, start;
+
+	if (words != NULL) {
+		t->words = *words;
+		t->nwords = 0;
+	}
+
+	if (t->s == NULL)
+		return 0;
+
+	while (1) {
+		while ( isspace(t->s[i]) )
+			i++;
+
+		if (t->s[i] == '\0')
+			break;
+
+		start = i;
+		while ( (t->s[i] != '\0') && !isspace(t->s[i]) )
+			i++;
+
+		if (words != NULL) {
+			(*words)->start = start;
+			(*words)->len = i - start;
+			(*words)++;
+		}
+		n++;
+	}
+
+	if (words != NULL)
+		t->nwords = n;
+
+	return n;
+}
+
+static enum simple_opt_result_type simple_opt_help_init(
+		struct simple_opt_help *h, char *command_name, char *command_options,
+		char *command_summary, struct simple_opt *options)
+{
+	int i;
+	unsigned j;
+	size_t text_size = 0, text_off = 0, nwords = 0;
+	struct simple_opt_help_word *w;
+	struct simple_opt_help_text *row;
+	struct sub_simple_opt_buf b;
+
+	h->options = options;
+	h->command_name.s = command_name;
+	h->command_name_len = command_name != NULL ? strlen(command_name) : 0;
+	h->command_options.s = command_options;
+	h->command_summary.s = command_summary;
+	h->desc_line_start = sub_simple_opt_desc_line_start(options);
+	h->cache_next = 0;
+
+	for (j = 0; j < SIMPLE_OPT_HELP_CACHE_SIZE; j++)
+		h->cache[j].s = NULL;
+
+	for (i = 0; options[i].type != SIMPLE_OPT_END; i++);
+	h->count = i;
+
+	/* work out how much space everything needs, then fill it in. columns 1
+	 * and 2 are generated, so need space in text, but their words are always
+	 * the whole column (barring any spaces in custom_arg_string) */
+	h->rows = (struct simple_opt_help_text *)malloc(
+			(3 * h->count + 1) * sizeof(*h->rows));
+	if (h->rows == NULL)
+		return SIMPLE_OPT_RESULT_OUT_OF_MEMORY;
+
+	nwords += sub_simple_opt_help_split(&h->command_name, NULL);
+	nwords += sub_simple_opt_help_split(&h->command_options, NULL);
+	nwords += sub_simple_opt_help_split(&h->command_summary, NULL);
+
+	for (i = 0; i < h->count; i++) {
+		row = h->rows + 3 * i;
+
+		text_size += 3 + sub_simple_opt_col2_width(options + i) + 1;
+
+		/* a word for each of the first two columns, plus however many spaces
+		 * a custom_arg_string might split column 2 into */
+		row[2].s = options[i].description;
+		nwords += 2 + sub_simple_opt_help_split(row + 2, NULL);
+		if (options[i].custom_arg_string != NULL)
+			nwords += strlen(options[i].custom_arg_string);
+	}
+
+	h->text = (char *)malloc(text_size + 1);
+	h->words = (struct simple_opt_help_word *)malloc(
+			(nwords + 1) * sizeof(*h->words));
+	if (h->text == NULL || h->words == NULL) {
+		free(h->rows);
+		free(h->text);
+		free(h->words);
+		return SIMPLE_OPT_RESULT_OUT_OF_MEMORY;
+	}
+
+	w = h->words;
+	sub_simple_opt_help_split(&h->command_name, &w);
+	sub_simple_opt_help_split(&h->command_options, &w);
+	sub_simple_opt_help_split(&h->command_summary, &w);
+
+	for (i = 0; i < h->count; i++) {
+		row = h->rows + 3 * i;
+
+		row[0].s = h->text + text_off;
+		h->text[text_off] = '-';
+		h->text[text_off + 1] = options[i].short_name;
+		h->text[text_off + 2] = '\0';
+		if (options[i].short_name == '\0')
+			h->text[text_off] = '\0';
+		text_off += 3;
+
+		row[1].s = h->text + text_off;
+		sub_simple_opt_buf_init_fixed(&b, h->text + text_off,
+				sub_simple_opt_col2_width(options + i) + 1);
+		sub_simple_opt_render_col2(&b, options + i);
+		text_off += sub_simple_opt_buf_finish(&b) + 1;
+
+		sub_simple_opt_help_split(row, &w);
+		sub_simple_opt_help_split(row + 1, &w);
+		sub_simple_opt_help_split(row + 2, &w);
+	}
+
+	return SIMPLE_OPT_RESULT_SUCCESS;
+}
+
+static void simple_opt_help_free(struct simple_opt_help *h)
+{
+	unsigned j;
+
+	for (j = 0; j < SIMPLE_OPT_HELP_CACHE_SIZE; j++)
+		free(h->cache[j].s);
+
+	free(h->rows);
+	free(h->text);
+	free(h->words);
+}
+
+/* render the usage message laid out in h at the given width, returning it and
+ * its length, or NULL if there's no memory to render it into. the result is
+ * owned by h, and cached until SIMPLE_OPT_HELP_CACHE_SIZE other widths have
+ * been rendered */
+static const char *simple_opt_help_render(struct simple_opt_help *h,
+		unsigned width, size_t *len)
+{
+	int i;
+	unsigned j, desc_line_start;
+	struct sub_simple_opt_buf b;
+
+	for (j = 0; j < SIMPLE_OPT_HELP_CACHE_SIZE; j++) {
+		if (h->cache[j].s != NULL && h->cache[j].width == width) {
+			*len = h->cache[j].len;
+			return h->cache[j].s;
+		}
+	}
 
-	case SIMPLE_OPT_RESULT_MISSING_ARG:
-		rval = snprintf(print_buffer, size,
-				"argument expected for option `%s`",
-				result.option_string);
-		break;
+	sub_simple_opt_buf_init_file(&b, NULL, NULL, 0);
 
-	case SIMPLE_OPT_RESULT_OPT_ARG_TOO_LONG:
-		rval = snprintf(print_buffer, size,
-				"argument passed to option `%s` is too long",
-				result.option_string);
-		break;
+	desc_line_start = h->desc_line_start;
+	if (desc_line_start > (width / 2 < 30 ? width / 2 : 30))
+		desc_line_start = (width / 2 < 30 ? width / 2 : 30);
 
-	case SIMPLE_OPT_RESULT_TOO_MANY_ARGS:
-		rval = snprintf(print_buffer, size,
-				"too many cli arguments received");
-		break;
+	sub_simple_opt_render_head(&b, width, &h->command_name,
+			h->command_name_len, &h->command_options, &h->command_summary);
 
-	case SIMPLE_OPT_RESULT_MALFORMED_OPTION_STRUCT:
-		rval = snprintf(print_buffer, size,
-				"malformed option struct (internal err)");
-		break;
+	for (i = 0; i < h->count; i++) {
+		sub_simple_opt_render_row(&b, width, desc_line_start,
+				h->rows + 3 * i, h->rows + 3 * i + 1, h->rows + 3 * i + 2);
+	}
+
+	if (b.failed) {
+		if (b.on_heap)
+			free(b.s);
+		return NULL;
+	}
+
+	/* nothing to print */
+	if (b.s == NULL) {
+		*len = 0;
+		return "";
+	}
+
+	j = h->cache_next;
+	h->cache_next = (h->cache_next + 1) % SIMPLE_OPT_HELP_CACHE_SIZE;
+
+	free(h->cache[j].s);
+	h->cache[j].width = width;
+	h->cache[j].s = b.s;
+	h->cache[j].len = b.len;
+
+	*len = b.len;
+	return b.s;
+}
+
+static void simple_opt_help_print(FILE *f, unsigned width,
+		struct simple_opt_help *h)
+{
+	const char *s;
+	size_t len;
+
+	s = simple_opt_help_render(h, width, &len);
+
+	if (s != NULL)
+		fwrite(s, 1, len, f);
+	else
+		simple_opt_print_usage(f, width, (char *)h->command_name.s,
+				(char *)h->command_options.s, (char *)h->command_summary.s,
+				h->options);
+}
+
+static void simple_opt_print_error_into(FILE *f, unsigned width,
+		char *command_name, const struct simple_opt_result_into *result)
+{
+	char stack_buf[SIMPLE_OPT_PRINT_BUFFER_WIDTH];
+	struct sub_simple_opt_buf b;
+
+	sub_simple_opt_buf_init_file(&b, f, stack_buf, sizeof(stack_buf));
+	sub_simple_opt_render_error(&b, width, command_name, result);
+	sub_simple_opt_buf_finish(&b);
+}
+
+static size_t simple_opt_render_error(char *buf, size_t len, unsigned width,
+		char *command_name, const struct simple_opt_result_into *result)
+{
+	struct sub_simple_opt_buf b;
+
+	sub_simple_opt_buf_init_fixed(&b, buf, len);
+	sub_simple_opt_render_error(&b, width, command_name, result);
+	return sub_simple_opt_buf_finish(&b);
+}
 
+static void simple_opt_print_error(FILE *f, unsigned width, char *command_name,
+		struct simple_opt_result result)
+{
+	struct simple_opt_result_into ri;
+
+	ri.result_type = result.result_type;
+	ri.source = SIMPLE_OPT_SOURCE_CLI;
+	ri.file = NULL;
+	ri.line = 0;
+	ri.option_type = result.option_type;
+	ri.option = result.option;
+	ri.option_string = result.option_string;
+	ri.argument_string = result.argument_string;
+
+	/* option_string is only set for errors relating to an option */
+	switch (result.result_type) {
+	case SIMPLE_OPT_RESULT_UNRECOGNISED_OPTION:
+	case SIMPLE_OPT_RESULT_BAD_ARG:
+	case SIMPLE_OPT_RESULT_MISSING_ARG:
+	case SIMPLE_OPT_RESULT_AMBIGUOUS_OPTION:
+	case SIMPLE_OPT_RESULT_OPT_ARG_TOO_LONG:
+	case SIMPLE_OPT_RESULT_BAD_RESPONSE_FILE:
+		ri.option_string_len = strlen(result.option_string);
+		break;
 	default:
+		ri.option_string_len = 0;
 		break;
 	}
 
-	if (rval < 0 || (unsigned)rval >= size) {
-		fprintf(f, "simple-opt internal err: print buffer too small");
+	simple_opt_print_error_into(f, width, command_name, &ri);
+}
+
+
+/* 
+ * shell completion
+ *
+ */
+
+enum sub_simple_opt_shell {
+	SUB_SIMPLE_OPT_SHELL_BASH,
+	SUB_SIMPLE_OPT_SHELL_ZSH,
+	SUB_SIMPLE_OPT_SHELL_FISH,
+};
+
+/* whether the first len chars of s are those of prefix, ignoring the case of
+ * ascii letters if nocase is set */
+static bool sub_simple_opt_has_prefix(const char *s, const char *prefix,
+		size_t len, bool nocase)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if (nocase ? sub_simple_opt_fold(s[i]) != sub_simple_opt_fold(prefix[i])
+				: s[i] != prefix[i])
+			return false;
+	}
+
+	return true;
+}
+
+/* print the strings of o's string set which start with the len chars at s,
+ * each after before */
+static void sub_simple_opt_complete_set(struct sub_simple_opt_buf *b,
+		const struct simple_opt *o, const char *before, size_t before_len,
+		const char *s, size_t len)
+{
+	int k;
+
+	for (k = 0; o->string_set[k] != NULL; k++) {
+		if (strlen(o->string_set[k]) < len || !sub_simple_opt_has_prefix(
+					o->string_set[k], s, len, o->string_set_nocase))
+			continue;
+
+		sub_simple_opt_buf_putn(b, before, before_len);
+		sub_simple_opt_buf_puts(b, o->string_set[k]);
+		sub_simple_opt_buf_putc(b, '\n');
+	}
+}
+
+/* print a long option as a completion. one which must have an argument is
+ * given its "=", so that the argument follows */
+static void sub_simple_opt_complete_long_name(struct sub_simple_opt_buf *b,
+		const struct simple_opt *o)
+{
+	sub_simple_opt_buf_puts(b, "--");
+	sub_simple_opt_buf_puts(b, o->long_name);
+	if (o->type != SIMPLE_OPT_FLAG && o->arg_is_required)
+		sub_simple_opt_buf_putc(b, '=');
+	sub_simple_opt_buf_putc(b, '\n');
+}
+
+/* print the long options whose names start with the len chars at s. they're
+ * adjacent once sorted, so it's a binary search for the first of them */
+static void sub_simple_opt_complete_long(struct sub_simple_opt_buf *b,
+		const struct simple_opt_index *idx, const char *s, size_t len)
+{
+	int lo = 0, hi = idx->long_count, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+
+		if (strncmp(idx->long_sorted[mid]->long_name, s, len) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (; lo < idx->long_count
+			&& !strncmp(idx->long_sorted[lo]->long_name, s, len); lo++)
+		sub_simple_opt_complete_long_name(b, idx->long_sorted[lo]);
+}
+
+/* the option which the cli argument s names in idx, or NULL */
+static const struct simple_opt *sub_simple_opt_complete_id(
+		const struct simple_opt_index *idx, char *s)
+{
+	struct sub_simple_opt_token t;
+	int opt_i;
+
+	if (s[0] != '-')
+		return NULL;
+
+	t.s = s;
+	t.len = sub_simple_opt_scan(s, &t.eq);
+
+	opt_i = sub_simple_opt_index_id(&t, idx);
+
+	return opt_i >= 0 ? idx->options + opt_i : NULL;
+}
+
+/* print the completions of the last of words, the cli arguments given so far,
+ * one to a line. nothing is printed where any word could follow, so that the
+ * shell can offer files */
+static void sub_simple_opt_complete(struct sub_simple_opt_buf *b,
+		const struct simple_opt_index *idx, int nwords, char **words)
+{
+	int i;
+	size_t len, eq;
+	char *cur = nwords > 0 ? words[nwords - 1] : (char *)"";
+	const struct simple_opt *o;
+
+	/* nothing after "--" is an option */
+	for (i = 0; i < nwords - 1; i++) {
+		if (!strcmp(words[i], "--"))
+			return;
+	}
+
+	len = sub_simple_opt_scan(cur, &eq);
+
+	/* the argument of the option before, unless it's optional and this is
+	 * another option */
+	o = nwords > 1 ? sub_simple_opt_complete_id(idx, words[nwords - 2]) : NULL;
+	if (o != NULL && o->type != SIMPLE_OPT_FLAG
+			&& strchr(words[nwords - 2], '=') == NULL
+			&& (words[nwords - 2][1] == '-' || words[nwords - 2][2] == '\0')
+			&& (o->arg_is_required || cur[0] != '-')) {
+		if (o->type == SIMPLE_OPT_STRING_SET)
+			sub_simple_opt_complete_set(b, o, "", 0, cur, len);
+		return;
+	}
+
+	if (cur[0] != '-')
+		return;
+
+	/* "--name=arg" */
+	if (cur[1] == '-' && eq < len) {
+		o = sub_simple_opt_complete_id(idx, cur);
+		if (o != NULL && o->type == SIMPLE_OPT_STRING_SET) {
+			sub_simple_opt_complete_set(b, o, cur, eq + 1, cur + eq + 1,
+					len - eq - 1);
+		}
+		return;
+	}
+
+	if (cur[1] == '-') {
+		sub_simple_opt_complete_long(b, idx, cur + 2, len - 2);
+		return;
+	}
+
+	/* a lone "-" could start any option */
+	if (cur[1] == '\0') {
+		for (i = 0; i < idx->count; i++) {
+			if (idx->options[i].short_name == '\0')
+				continue;
+
+			sub_simple_opt_buf_putc(b, '-');
+			sub_simple_opt_buf_putc(b, idx->options[i].short_name);
+			sub_simple_opt_buf_putc(b, '\n');
+		}
+
+		sub_simple_opt_complete_long(b, idx, "", 0);
+		return;
+	}
+
+	/* a short option is already complete */
+	if (cur[2] == '\0' && idx->short_table[(unsigned char)cur[1]] != -1) {
+		sub_simple_opt_buf_puts(b, cur);
+		sub_simple_opt_buf_putc(b, '\n');
+	}
+}
+
+/* write c within a single-quoted string */
+static void sub_simple_opt_complete_putc(struct sub_simple_opt_buf *b,
+		enum sub_simple_opt_shell shell, char c)
+{
+	if (c == '\n' || c == '\t')
+		c = ' ';
+
+	if (shell == SUB_SIMPLE_OPT_SHELL_FISH) {
+		if (c == '\'' || c == '\\')
+			sub_simple_opt_buf_putc(b, '\\');
+		sub_simple_opt_buf_putc(b, c);
+	} else if (c == '\'') {
+		sub_simple_opt_buf_puts(b, "'\\''");
+	} else {
+		sub_simple_opt_buf_putc(b, c);
+	}
+}
+
+/* write the n chars at s within a single-quoted string, with a backslash
+ * before any of the characters of special */
+static void sub_simple_opt_complete_putn(struct sub_simple_opt_buf *b,
+		enum sub_simple_opt_shell shell, const char *s, size_t n,
+		const char *special)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		if (strchr(special, s[i]) != NULL)
+			sub_simple_opt_complete_putc(b, shell, '\\');
+		sub_simple_opt_complete_putc(b, shell, s[i]);
+	}
+}
+
+static void sub_simple_opt_complete_puts(struct sub_simple_opt_buf *b,
+		enum sub_simple_opt_shell shell, const char *s, const char *special)
+{
+	sub_simple_opt_complete_putn(b, shell, s, strlen(s), special);
+}
+
+/* write o's string set, separated by spaces, within a single-quoted string */
+static void sub_simple_opt_complete_put_set(struct sub_simple_opt_buf *b,
+		enum sub_simple_opt_shell shell, const struct simple_opt *o,
+		const char *special)
+{
+	int k;
+
+	for (k = 0; o->string_set[k] != NULL; k++) {
+		if (k > 0)
+			sub_simple_opt_buf_putc(b, ' ');
+		sub_simple_opt_complete_puts(b, shell, o->string_set[k], special);
+	}
+}
+
+/* whether o's argument is completed as a file name */
+static bool sub_simple_opt_complete_is_file(const struct simple_opt *o)
+{
+	return o->type == SIMPLE_OPT_STRING || o->type == SIMPLE_OPT_STRING_LIST;
+}
+
+/* write the names of o, as they'd be matched by a bash case pattern */
+static void sub_simple_opt_complete_bash_names(struct sub_simple_opt_buf *b,
+		const struct simple_opt *o)
+{
+	if (o->short_name != '\0') {
+		sub_simple_opt_buf_puts(b, "'-");
+		sub_simple_opt_complete_putc(b, SUB_SIMPLE_OPT_SHELL_BASH,
+				o->short_name);
+		sub_simple_opt_buf_putc(b, '\'');
+	}
+
+	if (o->short_name != '\0' && o->long_name != NULL)
+		sub_simple_opt_buf_putc(b, '|');
+
+	if (o->long_name != NULL) {
+		sub_simple_opt_buf_puts(b, "'--");
+		sub_simple_opt_complete_puts(b, SUB_SIMPLE_OPT_SHELL_BASH,
+				o->long_name, "");
+		sub_simple_opt_buf_putc(b, '\'');
+	}
+}
+
+/* write a case arm replying with reply for the options whose required
+ * argument is, or isn't, a file name */
+static void sub_simple_opt_complete_bash_args(struct sub_simple_opt_buf *b,
+		const struct simple_opt *options, bool files, const char *reply)
+{
+	int i;
+	bool first = true;
+
+	for (i = 0; options[i].type != SIMPLE_OPT_END; i++) {
+		if (options[i].type == SIMPLE_OPT_FLAG
+				|| options[i].type == SIMPLE_OPT_STRING_SET
+				|| !options[i].arg_is_required
+				|| sub_simple_opt_complete_is_file(options + i) != files)
+			continue;
+
+		sub_simple_opt_buf_puts(b, first ? "\t\t" : "|");
+		sub_simple_opt_complete_bash_names(b, options + i);
+		first = false;
+	}
+
+	if (first)
+		return;
+
+	sub_simple_opt_buf_puts(b, ")\n\t\t\t");
+	sub_simple_opt_buf_puts(b, reply);
+	sub_simple_opt_buf_puts(b, "\n\t\t\treturn\n\t\t\t;;\n");
+}
+
+static void sub_simple_opt_complete_bash(struct sub_simple_opt_buf *b,
+		const char *name, const struct simple_opt *options)
+{
+	int i;
+	const char *c;
+	bool first;
+
+	sub_simple_opt_buf_puts(b, "_simple_opt_");
+	for (c = name; *c != '\0'; c++)
+		sub_simple_opt_buf_putc(b, isalnum((unsigned char)*c) ? *c : '_');
+	sub_simple_opt_buf_puts(b, "()\n"
+			"{\n"
+			"\tlocal line=${COMP_LINE:0:COMP_POINT} cur= prev= choices= "
+			"prefix=\n"
+			"\tlocal -a words\n"
+			"\n"
+			"\tread -ra words <<< \"$line\"\n"
+			"\tif [[ $line != *[[:space:]] && ${#words[@]} -gt 0 ]]; then\n"
+			"\t\tcur=${words[${#words[@]}-1]}\n"
+			"\t\tunset 'words[${#words[@]}-1]'\n"
+			"\tfi\n"
+			"\t[[ ${#words[@]} -gt 0 ]] && prev=${words[${#words[@]}-1]}\n"
+			"\n"
+			"\tcase $cur in\n");
+
+	/* "--name=arg" */
+	for (i = 0; options[i].type != SIMPLE_OPT_END; i++) {
+		if (options[i].type != SIMPLE_OPT_STRING_SET
+				|| options[i].long_name == NULL)
+			continue;
+
+		sub_simple_opt_buf_puts(b, "\t'--");
+		sub_simple_opt_complete_puts(b, SUB_SIMPLE_OPT_SHELL_BASH,
+				options[i].long_name, "");
+		sub_simple_opt_buf_puts(b, "='*)\n\t\tchoices='");
+		sub_simple_opt_complete_put_set(b, SUB_SIMPLE_OPT_SHELL_BASH,
+				options + i, "");
+		sub_simple_opt_buf_puts(b, "'\n"
+				"\t\t[[ $COMP_WORDBREAKS == *=* ]] || prefix=${cur%%=*}=\n"
+				"\t\tcur=${cur#*=}\n"
+				"\t\t;;\n");
+	}
+
+	/* an option's argument, as the next word */
+	sub_simple_opt_buf_puts(b, "\t*)\n\t\tcase $prev in\n");
+
+	for (i = 0; options[i].type != SIMPLE_OPT_END; i++) {
+		if (options[i].type != SIMPLE_OPT_STRING_SET)
+			continue;
+
+		sub_simple_opt_buf_puts(b, "\t\t");
+		sub_simple_opt_complete_bash_names(b, options + i);
+		sub_simple_opt_buf_puts(b, ")\n\t\t\tchoices='");
+		sub_simple_opt_complete_put_set(b, SUB_SIMPLE_OPT_SHELL_BASH,
+				options + i, "");
+		sub_simple_opt_buf_puts(b, "'\n\t\t\t;;\n");
+	}
+
+	sub_simple_opt_complete_bash_args(b, options, true,
+			"COMPREPLY=($(compgen -f -- \"$cur\"))");
+	sub_simple_opt_complete_bash_args(b, options, false, "COMPREPLY=()");
+
+	sub_simple_opt_buf_puts(b, "\t\tesac\n"
+			"\t\t;;\n"
+			"\tesac\n"
+			"\n"
+			"\tif [[ -z $choices && $cur == -* ]]; then\n"
+			"\t\tchoices='");
+
+	first = true;
+	for (i = 0; options[i].type != SIMPLE_OPT_END; i++) {
+		if (options[i].short_name != '\0') {
+			sub_simple_opt_buf_puts(b, first ? "-" : " -");
+			sub_simple_opt_complete_putc(b, SUB_SIMPLE_OPT_SHELL_BASH,
+					options[i].short_name);
+			first = false;
+		}
+
+		if (options[i].long_name != NULL) {
+			sub_simple_opt_buf_puts(b, first ? "--" : " --");
+			sub_simple_opt_complete_puts(b, SUB_SIMPLE_OPT_SHELL_BASH,
+					options[i].long_name, "");
+			if (options[i].type != SIMPLE_OPT_FLAG
+					&& options[i].arg_is_required)
+				sub_simple_opt_buf_putc(b, '=');
+			first = false;
+		}
+	}
+
+	sub_simple_opt_buf_puts(b, "'\n"
+			"\tfi\n"
+			"\n"
+			"\tif [[ -n $choices ]]; then\n"
+			"\t\tCOMPREPLY=($(compgen -P \"$prefix\" -W \"$choices\" -- "
+			"\"$cur\"))\n"
+			"\t\t[[ ${#COMPREPLY[@]} -eq 1 && $COMPREPLY == *= ]] "
+			"&& compopt -o nospace\n"
+			"\telse\n"
+			"\t\tCOMPREPLY=($(compgen -f -- \"$cur\"))\n"
+			"\tfi\n"
+			"}\n"
+			"\n"
+			"complete -F _simple_opt_");
+	for (c = name; *c != '\0'; c++)
+		sub_simple_opt_buf_putc(b, isalnum((unsigned char)*c) ? *c : '_');
+	sub_simple_opt_buf_puts(b, " '");
+	sub_simple_opt_complete_puts(b, SUB_SIMPLE_OPT_SHELL_BASH, name, "");
+	sub_simple_opt_buf_puts(b, "'\n");
+}
+
+/* write the spec of o's argument: its name, as shown in usage, and how it's
+ * completed */
+static void sub_simple_opt_complete_zsh_arg(struct sub_simple_opt_buf *b,
+		const struct simple_opt *o)
+{
+	sub_simple_opt_buf_puts(b, o->arg_is_required ? ":" : "::");
+	sub_simple_opt_complete_puts(b, SUB_SIMPLE_OPT_SHELL_ZSH,
+			sub_simple_opt_arg_name(o), ":\\");
+	sub_simple_opt_buf_putc(b, ':');
+
+	if (o->type == SIMPLE_OPT_STRING_SET) {
+		sub_simple_opt_buf_putc(b, '(');
+		sub_simple_opt_complete_put_set(b, SUB_SIMPLE_OPT_SHELL_ZSH, o,
+				" ()\\:");
+		sub_simple_opt_buf_putc(b, ')');
+	} else if (sub_simple_opt_complete_is_file(o)) {
+		sub_simple_opt_buf_puts(b, "_files");
+	} else {
+		sub_simple_opt_buf_putc(b, ' ');
+	}
+}
+
+static void sub_simple_opt_complete_zsh(struct sub_simple_opt_buf *b,
+		const char *name, const struct simple_opt *options)
+{
+	int i;
+	bool takes_arg;
+
+	(void)name;
+
+	sub_simple_opt_buf_puts(b, "_arguments -s -S");
+
+	for (i = 0; options[i].type != SIMPLE_OPT_END; i++) {
+		takes_arg = options[i].type != SIMPLE_OPT_FLAG;
+
+		sub_simple_opt_buf_puts(b, " \\\n\t");
+
+		/* flags and lists may be passed any number of times */
+		if (options[i].type == SIMPLE_OPT_FLAG
+				|| sub_simple_opt_is_list(options[i].type))
+			sub_simple_opt_buf_puts(b, "'*'");
+
+		if (options[i].short_name != '\0' && options[i].long_name != NULL)
+			sub_simple_opt_buf_putc(b, '{');
+
+		if (options[i].short_name != '\0') {
+			sub_simple_opt_buf_puts(b, "'-");
+			sub_simple_opt_complete_putn(b, SUB_SIMPLE_OPT_SHELL_ZSH,
+					&options[i].short_name, 1, "[]:\\{},");
+			if (takes_arg)
+				sub_simple_opt_buf_putc(b,
+						options[i].arg_is_required ? '+' : '-');
+			sub_simple_opt_buf_putc(b, '\'');
+		}
+
+		if (options[i].short_name != '\0' && options[i].long_name != NULL)
+			sub_simple_opt_buf_putc(b, ',');
+
+		if (options[i].long_name != NULL) {
+			sub_simple_opt_buf_puts(b, "'--");
+			sub_simple_opt_complete_puts(b, SUB_SIMPLE_OPT_SHELL_ZSH,
+					options[i].long_name, "[]:\\{},");
+			if (takes_arg)
+				sub_simple_opt_buf_puts(b,
+						options[i].arg_is_required ? "=" : "=-");
+			sub_simple_opt_buf_putc(b, '\'');
+		}
+
+		if (options[i].short_name != '\0' && options[i].long_name != NULL)
+			sub_simple_opt_buf_putc(b, '}');
+
+		sub_simple_opt_buf_puts(b, "'[");
+		if (options[i].description != NULL)
+			sub_simple_opt_complete_puts(b, SUB_SIMPLE_OPT_SHELL_ZSH,
+					options[i].description, "[]:\\");
+		sub_simple_opt_buf_putc(b, ']');
+
+		if (takes_arg)
+			sub_simple_opt_complete_zsh_arg(b, options + i);
+
+		sub_simple_opt_buf_putc(b, '\'');
+	}
+
+	sub_simple_opt_buf_puts(b, " \\\n\t'*:file:_files'\n");
+}
+
+static void sub_simple_opt_complete_fish(struct sub_simple_opt_buf *b,
+		const char *name, const struct simple_opt *options)
+{
+	int i;
+
+	for (i = 0; options[i].type != SIMPLE_OPT_END; i++) {
+		sub_simple_opt_buf_puts(b, "complete -c '");
+		sub_simple_opt_complete_puts(b, SUB_SIMPLE_OPT_SHELL_FISH, name, "");
+		sub_simple_opt_buf_putc(b, '\'');
+
+		if (options[i].short_name != '\0') {
+			sub_simple_opt_buf_puts(b, " -s '");
+			sub_simple_opt_complete_putc(b, SUB_SIMPLE_OPT_SHELL_FISH,
+					options[i].short_name);
+			sub_simple_opt_buf_putc(b, '\'');
+		}
+
+		if (options[i].long_name != NULL) {
+			sub_simple_opt_buf_puts(b, " -l '");
+			sub_simple_opt_complete_puts(b, SUB_SIMPLE_OPT_SHELL_FISH,
+					options[i].long_name, "");
+			sub_simple_opt_buf_putc(b, '\'');
+		}
+
+		/* a string set's argument is one of its strings, and not a file */
+		if (options[i].type == SIMPLE_OPT_STRING_SET) {
+			sub_simple_opt_buf_puts(b, " -x -a '");
+			sub_simple_opt_complete_put_set(b, SUB_SIMPLE_OPT_SHELL_FISH,
+					options + i, " \t'\"\\$()[]{}<>;&|*?~#");
+			sub_simple_opt_buf_putc(b, '\'');
+		} else if (options[i].type != SIMPLE_OPT_FLAG
+				&& options[i].arg_is_required) {
+			sub_simple_opt_buf_puts(b,
+					sub_simple_opt_complete_is_file(options + i)
+					? " -r" : " -x");
+		}
+
+		if (options[i].description != NULL) {
+			sub_simple_opt_buf_puts(b, " -d '");
+			sub_simple_opt_complete_puts(b, SUB_SIMPLE_OPT_SHELL_FISH,
+					options[i].description, "");
+			sub_simple_opt_buf_putc(b, '\'');
+		}
+
+		sub_simple_opt_buf_putc(b, '\n');
+	}
+}
+
+static bool simple_opt_print_completion_script(FILE *f, const char *shell,
+		const char *command_name, const struct simple_opt *options)
+{
+	char stack_buf[SIMPLE_OPT_PRINT_BUFFER_WIDTH];
+	struct sub_simple_opt_buf b;
+
+	if (strcmp(shell, "bash") && strcmp(shell, "zsh") && strcmp(shell, "fish"))
+		return false;
+
+	sub_simple_opt_buf_init_file(&b, f, stack_buf, sizeof(stack_buf));
+
+	if (!strcmp(shell, "zsh")) {
+		sub_simple_opt_buf_puts(&b, "#compdef ");
+		sub_simple_opt_buf_puts(&b, command_name);
+		sub_simple_opt_buf_putc(&b, '\n');
+	}
+
+	sub_simple_opt_buf_puts(&b, "# ");
+	sub_simple_opt_buf_puts(&b, shell);
+	sub_simple_opt_buf_puts(&b, " completion for ");
+	sub_simple_opt_buf_puts(&b, command_name);
+	sub_simple_opt_buf_puts(&b, ", generated by simple-opt\n\n");
+
+	if (!strcmp(shell, "bash"))
+		sub_simple_opt_complete_bash(&b, command_name, options);
+	else if (!strcmp(shell, "zsh"))
+		sub_simple_opt_complete_zsh(&b, command_name, options);
+	else
+		sub_simple_opt_complete_fish(&b, command_name, options);
+
+	sub_simple_opt_buf_finish(&b);
+
+	return !ferror(f);
+}
+
+static void simple_opt_complete_index(int argc, char **argv,
+		const struct simple_opt_index *idx)
+{
+	char stack_buf[SIMPLE_OPT_PRINT_BUFFER_WIDTH];
+	struct sub_simple_opt_buf b;
+	const char *name;
+
+	if (argc < 2)
 		return;
+
+	if (!strcmp(argv[1], SIMPLE_OPT_COMPLETE_ARG)) {
+		sub_simple_opt_buf_init_file(&b, stdout, stack_buf,
+				sizeof(stack_buf));
+		sub_simple_opt_complete(&b, idx, argc - 2, argv + 2);
+		sub_simple_opt_buf_finish(&b);
+		exit(ferror(stdout) ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+
+	if (!strcmp(argv[1], SIMPLE_OPT_COMPLETION_SCRIPT_ARG)) {
+		name = strrchr(argv[0], '/') != NULL ? strrchr(argv[0], '/') + 1
+			: argv[0];
+
+		exit(argc > 2 && simple_opt_print_completion_script(stdout, argv[2],
+					name, idx->options) ? EXIT_SUCCESS : EXIT_FAILURE);
 	}
+}
+
+static void simple_opt_complete(int argc, char **argv,
+		const struct simple_opt *options)
+{
+	struct simple_opt_index idx;
+
+	/* the options are only compiled if there's a query to answer, so this
+	 * costs nothing otherwise */
+	if (argc < 2 || (strcmp(argv[1], SIMPLE_OPT_COMPLETE_ARG)
+				&& strcmp(argv[1], SIMPLE_OPT_COMPLETION_SCRIPT_ARG)))
+		return;
+
+	if (simple_opt_compile(&idx, options) != SIMPLE_OPT_RESULT_SUCCESS)
+		exit(EXIT_FAILURE);
 
-	sub_simple_opt_wrap_print(f, width, col, line_start, print_buffer);
-	fprintf(f, "\n");
+	simple_opt_complete_index(argc, argv, &idx);
 }
 
 #endif
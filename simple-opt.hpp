@@ -0,0 +1,805 @@
+#ifndef SIMPLE_OPT_HPP
+#define SIMPLE_OPT_HPP
+
+/* a c++17 companion to simple-opt.h. options are declared in a constexpr
+ * array, from which everything simple_opt_compile would build at runtime (the
+ * short name table, the long name hash table, string set tables, and the
+ * width of the usage message's columns) is built at compile time instead.
+ * parsed values are read through typed getters rather than the union, and
+ * parsing allocates nothing from the heap */
+
+#include "simple-opt.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+namespace simpleopt {
+
+/* as struct simple_opt, without the values parsing assigns, and with a
+ * string_set which may itself be constexpr. the array needn't end in a
+ * SIMPLE_OPT_END option, but may */
+struct option {
+	enum simple_opt_type type;
+	char short_name = '\0';
+	const char *long_name = nullptr;
+	bool arg_is_required = false;
+	const char *description = nullptr;
+	const char *custom_arg_string = nullptr;
+	const char *const *string_set = nullptr;
+	bool string_set_nocase = false;
+	const char *env_name = nullptr;
+};
+
+/* the items of a list option, or the non-option arguments, each read as a T */
+template <class T, class E>
+class list {
+public:
+	class iterator {
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = T;
+		using difference_type = std::ptrdiff_t;
+		using pointer = void;
+		using reference = T;
+
+		constexpr explicit iterator(const E *p) : p_(p) {}
+		constexpr T operator*() const { return T(*p_); }
+		constexpr iterator &operator++() { p_++; return *this; }
+		constexpr iterator operator++(int) { iterator i = *this; p_++; return i; }
+		constexpr bool operator==(const iterator &o) const { return p_ == o.p_; }
+		constexpr bool operator!=(const iterator &o) const { return p_ != o.p_; }
+
+	private:
+		const E *p_;
+	};
+
+	constexpr list(const E *items, std::size_t count)
+		: items_(items), count_(count) {}
+
+	constexpr std::size_t size() const { return count_; }
+	constexpr bool empty() const { return count_ == 0; }
+	constexpr T operator[](std::size_t i) const { return T(items_[i]); }
+	constexpr iterator begin() const { return iterator(items_); }
+	constexpr iterator end() const { return iterator(items_ + count_); }
+
+private:
+	const E *items_;
+	std::size_t count_;
+};
+
+namespace detail {
+
+/*
+ * string handling, as simple-opt.h does it, but constexpr
+ *
+ */
+
+constexpr std::size_t length(const char *s)
+{
+	std::size_t n = 0;
+
+	while (s[n] != '\0')
+		n++;
+
+	return n;
+}
+
+/* as strcmp */
+constexpr int compare(const char *a, const char *b)
+{
+	for (; *a == *b; a++, b++) {
+		if (*a == '\0')
+			return 0;
+	}
+
+	return (unsigned char)*a < (unsigned char)*b ? -1 : 1;
+}
+
+constexpr unsigned char fold(char c)
+{
+	return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : (unsigned char)c;
+}
+
+constexpr bool equal(const char *a, const char *b, bool nocase)
+{
+	for (; nocase ? fold(*a) == fold(*b) : *a == *b; a++, b++) {
+		if (*a == '\0')
+			return true;
+	}
+
+	return false;
+}
+
+/* as sub_simple_opt_hash */
+constexpr std::uint32_t hash(const char *s, std::size_t len)
+{
+	std::uint32_t h = 2166136261u;
+
+	for (std::size_t i = 0; i < len; i++)
+		h = (h ^ (unsigned char)s[i]) * 16777619u;
+
+	return h;
+}
+
+/* as sub_simple_opt_set_hash */
+constexpr std::uint32_t set_hash(const option &o, const char *s)
+{
+	std::uint32_t h = 2166136261u;
+
+	for (std::size_t i = 0; s[i] != '\0'; i++)
+		h = (h ^ (o.string_set_nocase ? fold(s[i]) : (unsigned char)s[i]))
+			* 16777619u;
+
+	return h;
+}
+
+
+/*
+ * checks
+ *
+ */
+
+/* the number of options, up to any SIMPLE_OPT_END */
+template <const auto &Opts>
+constexpr std::size_t count()
+{
+	std::size_t n = 0;
+
+	while (n < std::size(Opts) && Opts[n].type != SIMPLE_OPT_END)
+		n++;
+
+	return n;
+}
+
+template <const auto &Opts>
+constexpr bool names_given()
+{
+	for (std::size_t i = 0; i < count<Opts>(); i++) {
+		if (Opts[i].short_name == '\0' && Opts[i].long_name == nullptr)
+			return false;
+	}
+
+	return true;
+}
+
+template <const auto &Opts>
+constexpr bool flags_take_no_arg()
+{
+	for (std::size_t i = 0; i < count<Opts>(); i++) {
+		if (Opts[i].type == SIMPLE_OPT_FLAG && Opts[i].arg_is_required)
+			return false;
+	}
+
+	return true;
+}
+
+template <const auto &Opts>
+constexpr bool sets_given()
+{
+	for (std::size_t i = 0; i < count<Opts>(); i++) {
+		if (Opts[i].type == SIMPLE_OPT_STRING_SET
+				&& Opts[i].string_set == nullptr)
+			return false;
+	}
+
+	return true;
+}
+
+template <const auto &Opts>
+constexpr bool short_names_unique()
+{
+	for (std::size_t i = 0; i < count<Opts>(); i++) {
+		for (std::size_t j = i + 1; j < count<Opts>(); j++) {
+			if (Opts[i].short_name != '\0'
+					&& Opts[i].short_name == Opts[j].short_name)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+template <const auto &Opts>
+constexpr bool long_names_unique()
+{
+	for (std::size_t i = 0; i < count<Opts>(); i++) {
+		for (std::size_t j = i + 1; j < count<Opts>(); j++) {
+			if (Opts[i].long_name != nullptr && Opts[j].long_name != nullptr
+					&& compare(Opts[i].long_name, Opts[j].long_name) == 0)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * tables, laid out exactly as sub_simple_opt_index_build lays them out
+ *
+ */
+
+/* the size of a table for the n hashes h: the smallest power of two at least
+ * twice n in which no two of them start probing at the same slot, so that a
+ * name is always found at the first slot tried. if there's none up to 1 << 16
+ * slots, the smallest half-full table, to be probed as usual */
+template <std::size_t N>
+constexpr std::uint32_t table_size(const std::array<std::uint32_t, N> &h,
+		std::size_t n)
+{
+	std::uint32_t min = 8, size = 0;
+	bool perfect = true;
+
+	while (min < 2 * n)
+		min *= 2;
+
+	for (size = min; size <= (1u << 16); size *= 2) {
+		perfect = true;
+
+		for (std::size_t i = 0; i < n && perfect; i++) {
+			for (std::size_t j = i + 1; j < n && perfect; j++) {
+				if (((h[i] ^ h[j]) & (size - 1)) == 0)
+					perfect = false;
+			}
+		}
+
+		if (perfect)
+			return size;
+	}
+
+	return min;
+}
+
+template <const auto &Opts>
+constexpr std::array<std::uint32_t, count<Opts>()> long_hashes()
+{
+	std::array<std::uint32_t, count<Opts>()> h{};
+
+	for (std::size_t i = 0; i < count<Opts>(); i++) {
+		if (Opts[i].long_name != nullptr)
+			h[i] = hash(Opts[i].long_name, length(Opts[i].long_name));
+	}
+
+	return h;
+}
+
+template <const auto &Opts>
+constexpr std::size_t long_count()
+{
+	std::size_t n = 0;
+
+	for (std::size_t i = 0; i < count<Opts>(); i++)
+		n += Opts[i].long_name != nullptr;
+
+	return n;
+}
+
+template <const auto &Opts>
+constexpr std::uint32_t long_size()
+{
+	std::array<std::uint32_t, count<Opts>()> h = long_hashes<Opts>();
+	std::size_t n = 0;
+
+	/* only the options with long names go in the table */
+	for (std::size_t i = 0; i < count<Opts>(); i++) {
+		if (Opts[i].long_name != nullptr)
+			h[n++] = h[i];
+	}
+
+	return table_size(h, n);
+}
+
+template <const auto &Opts>
+constexpr std::array<struct simple_opt_index_slot, long_size<Opts>()>
+make_long_table()
+{
+	std::array<struct simple_opt_index_slot, long_size<Opts>()> t{};
+	const std::uint32_t mask = long_size<Opts>() - 1;
+	std::uint32_t h = 0, j = 0;
+
+	for (j = 0; j <= mask; j++)
+		t[j].opt = -1;
+
+	for (std::size_t i = 0; i < count<Opts>(); i++) {
+		if (Opts[i].long_name == nullptr)
+			continue;
+
+		h = hash(Opts[i].long_name, length(Opts[i].long_name));
+
+		for (j = h & mask; t[j].opt != -1; j = (j + 1) & mask);
+
+		t[j].hash = h;
+		t[j].len = (std::uint32_t)length(Opts[i].long_name);
+		t[j].opt = (int)i;
+	}
+
+	return t;
+}
+
+/* the number of distinct strings in option i's string set, and their hashes */
+template <const auto &Opts, std::size_t I>
+constexpr std::size_t set_count()
+{
+	std::size_t n = 0, k = 0, l = 0;
+
+	if (Opts[I].type != SIMPLE_OPT_STRING_SET)
+		return 0;
+
+	for (k = 0; Opts[I].string_set[k] != nullptr; k++) {
+		for (l = 0; l < k && !equal(Opts[I].string_set[l],
+					Opts[I].string_set[k], Opts[I].string_set_nocase); l++);
+
+		n += l == k;
+	}
+
+	return n;
+}
+
+template <const auto &Opts, std::size_t I>
+constexpr std::uint32_t set_size()
+{
+	std::array<std::uint32_t, set_count<Opts, I>()> h{};
+	std::size_t n = 0, k = 0, l = 0;
+
+	if (Opts[I].type != SIMPLE_OPT_STRING_SET)
+		return 0;
+
+	for (k = 0; Opts[I].string_set[k] != nullptr; k++) {
+		for (l = 0; l < k && !equal(Opts[I].string_set[l],
+					Opts[I].string_set[k], Opts[I].string_set_nocase); l++);
+
+		if (l == k)
+			h[n++] = set_hash(Opts[I], Opts[I].string_set[k]);
+	}
+
+	return table_size(h, n);
+}
+
+/* every string set's table, one after another */
+template <const auto &Opts, std::size_t... I>
+constexpr std::array<std::size_t, sizeof...(I) + 1> set_offsets(
+		std::index_sequence<I...>)
+{
+	std::array<std::size_t, sizeof...(I) + 1> off{};
+	const std::uint32_t size[] = { set_size<Opts, I>()..., 0 };
+
+	for (std::size_t i = 0; i < sizeof...(I); i++)
+		off[i + 1] = off[i] + size[i];
+
+	return off;
+}
+
+template <const auto &Opts>
+inline constexpr std::array<std::size_t, count<Opts>() + 1> set_offset
+	= set_offsets<Opts>(std::make_index_sequence<count<Opts>()>());
+
+template <const auto &Opts>
+constexpr std::array<struct simple_opt_index_slot,
+	set_offset<Opts>[count<Opts>()]> make_set_pool()
+{
+	std::array<struct simple_opt_index_slot, set_offset<Opts>[count<Opts>()]>
+		t{};
+	std::uint32_t h = 0, j = 0, mask = 0;
+	std::size_t base = 0, k = 0;
+
+	for (j = 0; j < t.size(); j++)
+		t[j].opt = -1;
+
+	for (std::size_t i = 0; i < count<Opts>(); i++) {
+		if (Opts[i].type != SIMPLE_OPT_STRING_SET)
+			continue;
+
+		base = set_offset<Opts>[i];
+		mask = (std::uint32_t)(set_offset<Opts>[i + 1] - base - 1);
+
+		/* where a string is duplicated the first wins */
+		for (k = 0; Opts[i].string_set[k] != nullptr; k++) {
+			h = set_hash(Opts[i], Opts[i].string_set[k]);
+
+			for (j = h & mask; t[base + j].opt != -1; j = (j + 1) & mask) {
+				if (equal(Opts[i].string_set[t[base + j].opt],
+							Opts[i].string_set[k], Opts[i].string_set_nocase))
+					break;
+			}
+
+			if (t[base + j].opt != -1)
+				continue;
+
+			t[base + j].hash = h;
+			t[base + j].len = (std::uint32_t)length(Opts[i].string_set[k]);
+			t[base + j].opt = (int)k;
+		}
+	}
+
+	return t;
+}
+
+template <const auto &Opts>
+inline constexpr auto set_pool = make_set_pool<Opts>();
+
+template <const auto &Opts>
+constexpr std::array<struct simple_opt_index_set, count<Opts>() + 1>
+make_sets()
+{
+	std::array<struct simple_opt_index_set, count<Opts>() + 1> s{};
+
+	for (std::size_t i = 0; i < count<Opts>(); i++) {
+		if (set_offset<Opts>[i + 1] == set_offset<Opts>[i])
+			continue;
+
+		/* the c side only ever reads through these */
+		s[i].table = const_cast<struct simple_opt_index_slot *>(
+				set_pool<Opts>.data() + set_offset<Opts>[i]);
+		s[i].mask = (std::uint32_t)(set_offset<Opts>[i + 1]
+				- set_offset<Opts>[i] - 1);
+	}
+
+	return s;
+}
+
+constexpr struct simple_opt to_c(const option &o)
+{
+	return { o.type, o.short_name, o.long_name, o.arg_is_required,
+		o.description, o.custom_arg_string,
+		const_cast<const char **>(o.string_set), o.string_set_nocase,
+		o.env_name, false, false, SIMPLE_OPT_SOURCE_DEFAULT, {} };
+}
+
+template <const auto &Opts, std::size_t... I>
+constexpr std::array<struct simple_opt, sizeof...(I) + 1> make_c_options(
+		std::index_sequence<I...>)
+{
+	return {{ to_c(Opts[I])..., to_c(option{ SIMPLE_OPT_END }) }};
+}
+
+template <const auto &Opts>
+inline constexpr auto c_options
+	= make_c_options<Opts>(std::make_index_sequence<count<Opts>()>());
+
+template <const auto &Opts>
+inline constexpr auto long_table = make_long_table<Opts>();
+
+template <const auto &Opts>
+inline constexpr auto sets = make_sets<Opts>();
+
+/* the options with long names, sorted by name */
+template <const auto &Opts>
+constexpr std::array<const struct simple_opt *, long_count<Opts>() + 1>
+make_long_sorted()
+{
+	std::array<const struct simple_opt *, long_count<Opts>() + 1> s{};
+	const struct simple_opt *o = nullptr;
+	std::size_t n = 0, k = 0;
+
+	for (std::size_t i = 0; i < count<Opts>(); i++) {
+		if (Opts[i].long_name == nullptr)
+			continue;
+
+		o = c_options<Opts>.data() + i;
+
+		for (k = n; k > 0 && compare(s[k - 1]->long_name, o->long_name) > 0;
+				k--)
+			s[k] = s[k - 1];
+
+		s[k] = o;
+		n++;
+	}
+
+	return s;
+}
+
+template <const auto &Opts>
+inline constexpr auto long_sorted = make_long_sorted<Opts>();
+
+template <const auto &Opts>
+constexpr struct simple_opt_index make_index()
+{
+	struct simple_opt_index idx{};
+
+	idx.options = c_options<Opts>.data();
+	idx.count = (int)count<Opts>();
+
+	for (int i = 0; i < 256; i++)
+		idx.short_table[i] = -1;
+
+	for (std::size_t i = 0; i < count<Opts>(); i++) {
+		if (Opts[i].short_name != '\0')
+			idx.short_table[(unsigned char)Opts[i].short_name] = (int)i;
+	}
+
+	idx.long_table = const_cast<struct simple_opt_index_slot *>(
+			long_table<Opts>.data());
+	idx.long_mask = long_size<Opts>() - 1;
+
+	idx.long_sorted = const_cast<const struct simple_opt **>(
+			long_sorted<Opts>.data());
+	idx.long_count = (int)long_count<Opts>();
+
+	idx.sets = const_cast<struct simple_opt_index_set *>(sets<Opts>.data());
+
+	/* the schema's static_asserts have done what validating would */
+	idx.validated = true;
+
+	return idx;
+}
+
+template <const auto &Opts>
+inline constexpr struct simple_opt_index index = make_index<Opts>();
+
+/* as sub_simple_opt_col2_width */
+constexpr std::size_t col2_width(const option &o)
+{
+	std::size_t j = 0;
+
+	if (o.long_name != nullptr)
+		j += 3 + length(o.long_name);
+
+	if (!o.arg_is_required && o.type != SIMPLE_OPT_FLAG)
+		j += 2;
+
+	if (o.type == SIMPLE_OPT_FLAG)
+		return j;
+
+	if (o.custom_arg_string != nullptr)
+		return j + length(o.custom_arg_string);
+
+	switch (o.type) {
+	case SIMPLE_OPT_BOOL:
+	case SIMPLE_OPT_CHAR:
+		return j + 4;
+	case SIMPLE_OPT_INT:
+	case SIMPLE_OPT_INT_LIST:
+		return j + 3;
+	case SIMPLE_OPT_UNSIGNED:
+	case SIMPLE_OPT_UNSIGNED_LIST:
+		return j + 8;
+	case SIMPLE_OPT_DOUBLE:
+	case SIMPLE_OPT_DOUBLE_LIST:
+	case SIMPLE_OPT_STRING:
+	case SIMPLE_OPT_STRING_SET:
+	case SIMPLE_OPT_STRING_LIST:
+		return j + 6;
+	default:
+		return j;
+	}
+}
+
+/* as sub_simple_opt_desc_line_start */
+template <const auto &Opts>
+constexpr unsigned desc_line_start()
+{
+	unsigned n = 5;
+
+	for (std::size_t i = 0; i < count<Opts>(); i++) {
+		if (n < col2_width(Opts[i]) + 5 + 2)
+			n = (unsigned)(col2_width(Opts[i]) + 5 + 2);
+	}
+
+	return n;
+}
+
+} /* namespace detail */
+
+/* a constexpr array of options, checked and compiled at compile time */
+template <const auto &Opts>
+class schema {
+	static_assert(detail::names_given<Opts>(),
+			"an option needs a short_name or a long_name");
+	static_assert(detail::flags_take_no_arg<Opts>(),
+			"a SIMPLE_OPT_FLAG option can't require an argument");
+	static_assert(detail::sets_given<Opts>(),
+			"a SIMPLE_OPT_STRING_SET option needs a string_set");
+	static_assert(detail::short_names_unique<Opts>(),
+			"two options have the same short_name");
+	static_assert(detail::long_names_unique<Opts>(),
+			"two options have the same long_name");
+
+public:
+	static constexpr std::size_t count = detail::count<Opts>();
+
+	/* the options as simple-opt.h sees them, ending in SIMPLE_OPT_END, and an
+	 * index over them which needn't be compiled or freed */
+	static constexpr const struct simple_opt *options
+		= detail::c_options<Opts>.data();
+	static constexpr const struct simple_opt_index *index
+		= &detail::index<Opts>;
+
+	static constexpr unsigned desc_line_start
+		= detail::desc_line_start<Opts>();
+
+	/* the position of the option with long_name, for the getters of
+	 * simpleopt::values, or count if there's none */
+	static constexpr std::size_t id(const char *long_name)
+	{
+		for (std::size_t i = 0; i < count; i++) {
+			if (Opts[i].long_name != nullptr
+					&& detail::compare(Opts[i].long_name, long_name) == 0)
+				return i;
+		}
+
+		return count;
+	}
+
+	static constexpr std::size_t id(char short_name)
+	{
+		for (std::size_t i = 0; i < count; i++) {
+			if (Opts[i].short_name == short_name)
+				return i;
+		}
+
+		return count;
+	}
+
+	static void print_usage(FILE *f, unsigned width,
+			const char *command_name, const char *command_options,
+			const char *command_summary)
+	{
+		char stack_buf[SIMPLE_OPT_PRINT_BUFFER_WIDTH];
+		struct sub_simple_opt_buf b;
+
+		sub_simple_opt_buf_init_file(&b, f, stack_buf, sizeof(stack_buf));
+		render(&b, width, command_name, command_options, command_summary);
+		sub_simple_opt_buf_finish(&b);
+	}
+
+	static std::size_t render_usage(char *buf, std::size_t len,
+			unsigned width, const char *command_name,
+			const char *command_options, const char *command_summary)
+	{
+		struct sub_simple_opt_buf b;
+
+		sub_simple_opt_buf_init_fixed(&b, buf, len);
+		render(&b, width, command_name, command_options, command_summary);
+		return sub_simple_opt_buf_finish(&b);
+	}
+
+	static void complete(int argc, char **argv)
+	{
+		simple_opt_complete_index(argc, argv, index);
+	}
+
+private:
+	static void render(struct sub_simple_opt_buf *b, unsigned width,
+			const char *command_name, const char *command_options,
+			const char *command_summary)
+	{
+		sub_simple_opt_render_usage(b, width,
+				const_cast<char *>(command_name),
+				const_cast<char *>(command_options),
+				const_cast<char *>(command_summary),
+				const_cast<struct simple_opt *>(options), NULL,
+				desc_line_start);
+	}
+};
+
+/* the values parsed from a cli for the options of Schema. everything parsing
+ * allocates, such as list items, comes from arena_size bytes kept in the
+ * object itself, and parsing fails with SIMPLE_OPT_RESULT_OUT_OF_MEMORY
+ * rather than go to the heap. non-option arguments are moved down the argv
+ * parsed, which, along with any strings pointed into it, must outlive the
+ * values */
+template <class Schema, std::size_t arena_size = 4096>
+class values {
+public:
+	values()
+	{
+		simple_opt_arena_init(&arena_, buf_, sizeof(buf_));
+		arena_.chunk_size = 0;
+
+		r_ = {};
+		r_.arena = &arena_;
+
+		sub_simple_opt_values_clear(Schema::options, vals_,
+				(int)Schema::count);
+	}
+
+	values(const values &) = delete;
+	values &operator=(const values &) = delete;
+
+	/* parse afresh, forgetting anything parsed before */
+	enum simple_opt_result_type parse(int argc, char **argv)
+	{
+		simple_opt_arena_reset(&arena_);
+		sub_simple_opt_values_clear(Schema::options, vals_,
+				(int)Schema::count);
+
+		r_.response_files = NULL;
+		args_ = argv + 1;
+
+		return simple_opt_parse_index_values(argc, argv, Schema::index, vals_,
+				&r_);
+	}
+
+	/* whether option I was passed, whether or not with an argument */
+	template <std::size_t I>
+	bool seen() const
+	{
+		static_assert(I < Schema::count, "no such option");
+
+		return vals_[I].was_seen;
+	}
+
+	/* option I's argument, as the type its own type calls for, or nothing if
+	 * it wasn't given one. a flag gives the number of times it was passed,
+	 * a string set the string matched, and a list every item passed */
+	template <std::size_t I>
+	auto get() const
+	{
+		static_assert(I < Schema::count, "no such option");
+
+		constexpr enum simple_opt_type type = Schema::options[I].type;
+		const struct simple_opt_value &v = vals_[I];
+
+		if constexpr (type == SIMPLE_OPT_FLAG) {
+			return v.was_seen ? std::optional<unsigned long>(v.val.v_count)
+				: std::nullopt;
+		} else if constexpr (type == SIMPLE_OPT_BOOL) {
+			return v.arg_is_stored ? std::optional<bool>(v.val.v_bool)
+				: std::nullopt;
+		} else if constexpr (type == SIMPLE_OPT_INT) {
+			return v.arg_is_stored ? std::optional<long>(v.val.v_int)
+				: std::nullopt;
+		} else if constexpr (type == SIMPLE_OPT_UNSIGNED) {
+			return v.arg_is_stored
+				? std::optional<unsigned long>(v.val.v_unsigned)
+				: std::nullopt;
+		} else if constexpr (type == SIMPLE_OPT_DOUBLE) {
+			return v.arg_is_stored ? std::optional<double>(v.val.v_double)
+				: std::nullopt;
+		} else if constexpr (type == SIMPLE_OPT_CHAR) {
+			return v.arg_is_stored ? std::optional<char>(v.val.v_char)
+				: std::nullopt;
+		} else if constexpr (type == SIMPLE_OPT_STRING) {
+			return v.arg_is_stored ? std::optional<std::string_view>(
+					std::string_view(v.val.v_string.str,
+						v.val.v_string.len))
+				: std::nullopt;
+		} else if constexpr (type == SIMPLE_OPT_STRING_SET) {
+			return v.arg_is_stored ? std::optional<std::string_view>(
+					Schema::options[I].string_set[v.val.v_string_set_idx])
+				: std::nullopt;
+		} else if constexpr (type == SIMPLE_OPT_INT_LIST) {
+			return list<long, long>(v.val.v_list.items.v_int,
+					v.val.v_list.count);
+		} else if constexpr (type == SIMPLE_OPT_UNSIGNED_LIST) {
+			return list<unsigned long, unsigned long>(
+					v.val.v_list.items.v_unsigned, v.val.v_list.count);
+		} else if constexpr (type == SIMPLE_OPT_DOUBLE_LIST) {
+			return list<double, double>(v.val.v_list.items.v_double,
+					v.val.v_list.count);
+		} else {
+			return list<std::string_view, char *>(v.val.v_list.items.v_string,
+					v.val.v_list.count);
+		}
+	}
+
+	/* the non-option arguments */
+	list<std::string_view, char *> args() const
+	{
+		return list<std::string_view, char *>(args_, r_.argc);
+	}
+
+	/* the details of a failed parse, for simple_opt_print_error_into and
+	 * simple_opt_render_error */
+	const struct simple_opt_result_into &result() const { return r_; }
+
+	/* the values as simple-opt.h sees them */
+	const struct simple_opt_value *data() const { return vals_; }
+
+private:
+	struct simple_opt_value vals_[Schema::count > 0 ? Schema::count : 1];
+	struct simple_opt_result_into r_;
+	char **args_ = nullptr;
+	struct simple_opt_arena arena_;
+	alignas(union sub_simple_opt_align) char buf_[arena_size > 0
+		? arena_size : 1];
+};
+
+} /* namespace simpleopt */
+
+#endif